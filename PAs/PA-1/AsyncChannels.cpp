@@ -0,0 +1,286 @@
+#include "AsyncChannels.h"
+
+#include <errno.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+
+#ifdef __linux__
+/* The submission and completion rings shared with the kernel. Without liburing the ring
+pointers come from the offsets io_uring_setup reports; the kernel reads the SQ tail and
+writes the CQ tail, so those are accessed with acquire/release ordering. */
+struct AsyncChannels::Ring {
+	int fd;
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	struct io_uring_sqe* sqes;
+	size_t sqes_len;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe* cqes;
+	unsigned to_submit;
+};
+
+static AsyncChannels::Ring* open_ring (unsigned entries) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		return NULL;  // e.g. an old kernel, or io_uring disabled by a sysctl or seccomp
+	}
+	AsyncChannels::Ring* r = new AsyncChannels::Ring();
+	r->fd = fd;
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->sq_len = r->cq_len = max(r->sq_len, r->cq_len);
+	}
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	r->cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq_ptr
+		: mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe*) mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+		close(fd);
+		delete r;
+		return NULL;
+	}
+	char* sq = (char*) r->sq_ptr;
+	r->sq_head = (unsigned*) (sq + p.sq_off.head);
+	r->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+	r->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned*) (sq + p.sq_off.array);
+	char* cq = (char*) r->cq_ptr;
+	r->cq_head = (unsigned*) (cq + p.cq_off.head);
+	r->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+	r->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+	r->to_submit = 0;
+	return r;
+}
+
+static void close_ring (AsyncChannels::Ring* r) {
+	munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr != r->sq_ptr) {
+		munmap(r->cq_ptr, r->cq_len);
+	}
+	munmap(r->sq_ptr, r->sq_len);
+	close(r->fd);
+	delete r;
+}
+
+static int enter_ring (AsyncChannels::Ring* r, unsigned min_complete) {
+	int n;
+	do {
+		n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n >= 0) {
+		r->to_submit -= n;
+	}
+	return n;
+}
+#else
+struct AsyncChannels::Ring {};
+#endif
+
+
+AsyncChannels::AsyncChannels (const vector<RequestChannel*>& _channels, Backend backend, int _max_inflight, long _window)
+	: max_inflight(max(_max_inflight, 1)), window(_window), outstanding(0), ring(NULL) {
+	for (RequestChannel* chan : _channels) {
+		int limit = chan->max_queued() > 0 ? min(max_inflight, chan->max_queued()) : max_inflight;
+		channels.push_back({chan, chan->read_fd(), limit, {}, {}, 0, false});
+	}
+#ifdef __linux__
+	if (backend != POLL) {
+		// every channel has at most one poll armed, so the rings never overflow
+		unsigned entries = 1;
+		while (entries < channels.size()) {
+			entries <<= 1;
+		}
+		ring = open_ring(entries);
+		if (!ring && backend == IO_URING) {
+			cerr << "io_uring is not available, using poll" << endl;
+		}
+	}
+#else
+	(void) backend;
+#endif
+}
+
+AsyncChannels::~AsyncChannels () {
+#ifdef __linux__
+	if (ring) {
+		close_ring(ring);
+	}
+#endif
+}
+
+void AsyncChannels::submit (int ch, const void* request, int reqlen, void* reply, int replylen, uint64_t tag) {
+	channels[ch].unsent.push_back({tag, request, reqlen, reply, replylen});
+	outstanding++;
+	flush(ch);
+}
+
+// writes the waiting requests of ch that fit into its limits
+void AsyncChannels::flush (int ch) {
+	Channel& c = channels[ch];
+	while (!c.unsent.empty()) {
+		Op& op = c.unsent.front();
+		// a single request always goes, even if its reply alone is larger than the window
+		if (!c.sent.empty() && ((int) c.sent.size() >= c.limit || (window > 0 && c.sent_bytes + op.replylen > window))) {
+			break;
+		}
+		if (c.chan->cwrite((void*) op.request, op.reqlen) != op.reqlen) {
+			done.push_back({op.tag, ch, -1});
+			outstanding--;
+			c.unsent.pop_front();
+			continue;
+		}
+		c.sent_bytes += op.replylen;
+		c.sent.push_back(op);
+		c.unsent.pop_front();
+	}
+	if (!c.sent.empty()) {
+		arm(ch);
+	}
+}
+
+void AsyncChannels::arm (int ch) {
+	Channel& c = channels[ch];
+	if (c.armed || c.fd < 0) {
+		return;
+	}
+	c.armed = true;
+#ifdef __linux__
+	if (ring) {
+		unsigned tail = *ring->sq_tail;
+		unsigned index = tail & *ring->sq_mask;
+		struct io_uring_sqe* sqe = &ring->sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = c.fd;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = ch;
+		ring->sq_array[index] = index;
+		__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+		ring->to_submit++;
+	}
+#endif
+}
+
+// reads the reply at the front of ch, which has arrived or is arriving
+void AsyncChannels::ready (int ch) {
+	Channel& c = channels[ch];
+	if (c.sent.empty()) {
+		return;
+	}
+	Op op = c.sent.front();
+	// every transport delivers a whole message per cread, so one call is the whole reply
+	int n = c.chan->cread(op.reply, op.replylen);
+	if (n <= 0) {
+		fail(ch);  // the channel is out of step with its replies now
+		return;
+	}
+	c.sent.pop_front();
+	c.sent_bytes -= op.replylen;
+	done.push_back({op.tag, ch, n});
+	outstanding--;
+	flush(ch);
+}
+
+// completes everything queued on ch as failed
+void AsyncChannels::fail (int ch) {
+	Channel& c = channels[ch];
+	for (deque<Op>* q : {&c.sent, &c.unsent}) {
+		for (Op& op : *q) {
+			done.push_back({op.tag, ch, -1});
+			outstanding--;
+		}
+		q->clear();
+	}
+	c.sent_bytes = 0;
+}
+
+int AsyncChannels::wait (Completion* out, int max) {
+	while (done.empty() && outstanding > 0) {
+		/* channels without a descriptor only have a blocking read, and a reply the channel
+		 already holds (can_read) would never make its descriptor readable */
+		for (size_t ch = 0; ch < channels.size(); ch++) {
+			Channel& c = channels[ch];
+			if (!c.sent.empty() && (c.fd < 0 || c.chan->can_read())) {
+				ready(ch);
+			}
+		}
+		if (!done.empty()) {
+			break;
+		}
+		if (ring) {
+			wait_io_uring();
+		}
+		else {
+			wait_poll();
+		}
+	}
+	int n = 0;
+	while (n < max && !done.empty()) {
+		out[n++] = done.front();
+		done.pop_front();
+	}
+	return n;
+}
+
+void AsyncChannels::wait_io_uring () {
+#ifdef __linux__
+	if (enter_ring(ring, 1) < 0) {
+		EXITONERROR("io_uring_enter");
+	}
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+		int ch = (int) cqe->user_data;
+		int res = cqe->res;
+		// hand the entry back before ready() may arm the channel again
+		__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+		channels[ch].armed = false;
+		if (res < 0) {
+			fail(ch);
+		}
+		else {
+			ready(ch);
+		}
+	}
+#endif
+}
+
+void AsyncChannels::wait_poll () {
+	pfds.clear();
+	for (Channel& c : channels) {
+		if (c.armed) {
+			pfds.push_back({c.fd, POLLIN, 0});
+		}
+	}
+	if (poll(pfds.data(), pfds.size(), -1) < 0) {
+		if (errno == EINTR) {
+			return;
+		}
+		EXITONERROR("poll");
+	}
+	size_t i = 0;
+	for (size_t ch = 0; ch < channels.size(); ch++) {
+		if (!channels[ch].armed) {
+			continue;
+		}
+		if (pfds[i++].revents) {
+			channels[ch].armed = false;
+			ready(ch);
+		}
+	}
+}
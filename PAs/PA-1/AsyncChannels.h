@@ -0,0 +1,90 @@
+#ifndef _AsyncChannels_H_
+#define _AsyncChannels_H_
+
+#include "RequestChannel.h"
+
+#include <deque>
+#include <stdint.h>
+#include <poll.h>
+
+
+class AsyncChannels {
+public:
+	enum Backend {AUTO, IO_URING, POLL};
+
+	struct Completion {
+		uint64_t tag;          // as given to submit
+		int channel;           // index into the channels the set was created with
+		int result;            // bytes in the reply, 0 or -1 if the channel failed
+	};
+
+	struct Ring;  // the io_uring mappings, see AsyncChannels.cpp
+
+private:
+	/* Lets a single thread keep many requests in flight on many channels. Every request
+	 on these channels has exactly one reply, in order, so an operation is a request
+	 together with its reply: submit writes the request and returns, and the reply is
+	 read with one cread once its channel becomes readable. With io_uring, readiness is a POLL_ADD per
+	 channel in a ring set up with raw system calls, so arming and waiting for all the
+	 channels is one io_uring_enter; otherwise it is a poll(2) over their descriptors.
+	 Channels without a descriptor (shared memory) are read in order, blocking, and so
+	 is a reply the channel has already read ahead (can_read), which poll cannot see.
+
+	 A channel gets at most max_inflight requests (and no more than its max_queued), and
+	 with a window no more than window bytes of replies ahead of its reader; further
+	 requests wait in the set until replies come back. So a write never finds the request
+	 direction full while the server is stuck on a full reply direction, however many
+	 requests are submitted. The request count alone ensures that, so by default there is
+	 no window and large replies are pipelined as deep as small ones. */
+	struct Op {
+		uint64_t tag;
+		const void* request;
+		int reqlen;
+		void* reply;
+		int replylen;
+	};
+	struct Channel {
+		RequestChannel* chan;
+		int fd;
+		int limit;                // requests in flight at most
+		std::deque<Op> unsent;
+		std::deque<Op> sent;      // written, the replies arrive in this order
+		long sent_bytes;          // reply bytes of sent
+		bool armed;               // waiting for readiness
+	};
+	std::vector<Channel> channels;
+	std::deque<Completion> done;
+	int max_inflight;
+	long window;                  // 0 for no limit on the reply bytes
+	int outstanding;              // submitted and not yet completed
+	Ring* ring;                   // NULL with the poll backend
+	std::vector<struct pollfd> pfds;
+
+	void flush (int ch);
+	void arm (int ch);
+	void ready (int ch);
+	void fail (int ch);
+	void wait_io_uring ();
+	void wait_poll ();
+
+public:
+	AsyncChannels (const std::vector<RequestChannel*>& _channels, Backend backend = AUTO, int _max_inflight = 8, long _window = 0);
+	/* The channels stay owned by the caller and must not be used directly while requests
+	 are outstanding. AUTO uses io_uring where the kernel allows it and poll otherwise. */
+	~AsyncChannels ();
+
+	void submit (int ch, const void* request, int reqlen, void* reply, int replylen, uint64_t tag);
+	/* Queues a request on channel ch whose reply, a single message, fits into replylen
+	 bytes. The request and the reply buffer must stay valid until the completion with
+	 this tag is returned. */
+
+	int wait (Completion* out, int max);
+	/* Blocks until at least one operation has completed, stores up to max completions in
+	 out and returns how many. Returns 0 right away if nothing is outstanding. */
+
+	int pending () const { return outstanding; }
+
+	const char* backend () const { return ring ? "io_uring" : "poll"; }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "BoundedBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+BoundedBuffer::BoundedBuffer (int _cap) : cap(max(_cap, 1)) {
+}
+
+BoundedBuffer::~BoundedBuffer () {
+}
+
+void BoundedBuffer::push (char* msg, int size) {
+	vector<char> item(msg, msg + size);  // copy outside of the lock
+	unique_lock<mutex> lock(mtx);
+	not_full.wait(lock, [this] { return (int) q.size() < cap; });
+	q.push(move(item));
+	lock.unlock();
+	not_empty.notify_one();
+}
+
+int BoundedBuffer::pop (char* buf, int bufcap) {
+	unique_lock<mutex> lock(mtx);
+	not_empty.wait(lock, [this] { return !q.empty(); });
+	vector<char> item = move(q.front());
+	q.pop();
+	lock.unlock();
+	not_full.notify_one();
+
+	int size = item.size();
+	memcpy(buf, item.data(), min(size, bufcap));
+	return size;
+}
+
+size_t BoundedBuffer::size () {
+	lock_guard<mutex> lock(mtx);
+	return q.size();
+}
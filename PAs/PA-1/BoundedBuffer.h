@@ -0,0 +1,36 @@
+#ifndef _BoundedBuffer_H_
+#define _BoundedBuffer_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+
+class BoundedBuffer {
+private:
+	/* A thread-safe FIFO queue of byte messages holding at most cap of them: push blocks
+	 while the buffer is full and pop blocks while it is empty, so producers that run ahead
+	 of their consumers are throttled instead of growing memory without bound. */
+	int cap;
+	std::queue<std::vector<char>> q;
+
+	std::mutex mtx;
+	std::condition_variable not_full;
+	std::condition_variable not_empty;
+
+public:
+	BoundedBuffer (int _cap);
+	~BoundedBuffer ();
+
+	void push (char* msg, int size);
+	/* Copies size bytes of msg into the buffer, waiting for a free slot if necessary. */
+
+	int pop (char* buf, int bufcap);
+	/* Removes the oldest message, waiting for one if necessary, and copies it into buf.
+	 Returns the size of the message; bytes beyond bufcap are dropped. */
+
+	size_t size ();
+};
+
+#endif
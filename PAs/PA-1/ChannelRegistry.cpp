@@ -0,0 +1,111 @@
+#include "ChannelRegistry.h"
+#include "ServerStats.h"
+
+#include <poll.h>
+#include <sched.h>
+
+using namespace std;
+
+
+/*--------------------------------------------------------------------------*/
+/*		MEMBER FUNCTIONS FOR CLASS	C h a n n e l R e g i s t r y			*/
+/*--------------------------------------------------------------------------*/
+
+ChannelRegistry::ChannelRegistry () : next_id(0), live(0), stopping(false), max_channels(0), idle_ns(0) {}
+
+ChannelRegistry::~ChannelRegistry () {
+	shutdown();
+}
+
+void ChannelRegistry::set_limits (int _max_channels, int idle_seconds) {
+	max_channels = max(_max_channels, 0);
+	idle_ns = (uint64_t) max(idle_seconds, 0) * 1000000000;
+}
+
+bool ChannelRegistry::admit () {
+	int n = live.load();
+	do {
+		if (max_channels > 0 && n >= max_channels) {
+			return false;
+		}
+	} while (!live.compare_exchange_weak(n, n + 1));
+	return true;
+}
+
+void ChannelRegistry::join_workers (bool all) {
+	lock_guard<mutex> lock(mtx);
+	for (auto it = workers.begin(); it != workers.end(); ) {
+		Worker* w = *it;
+		if (all || w->done) {
+			if (w->th.get_id() == this_thread::get_id()) {
+				w->th.detach();  // exit() from a channel thread runs the destructor there
+			}
+			else {
+				w->th.join();
+			}
+			delete w;
+			it = workers.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void ChannelRegistry::spawn (function<void()> serve) {
+	join_workers(false);
+	Worker* w = new Worker;
+	lock_guard<mutex> lock(mtx);
+	w->th = thread([w, serve] {
+		serve();
+		w->done = true;
+	});
+	workers.push_back(w);
+}
+
+bool ChannelRegistry::wait_for_request (RequestChannel* channel, bool may_idle) {
+	int fd = channel->read_fd();
+	uint64_t since = now_ns();
+	if (fd < 0) {
+		// nothing to poll (shared memory): spin at first like its cread, then back off
+		for (int spins = 0; !stopping; spins++) {
+			if (channel->can_read()) {
+				return true;
+			}
+			if (spins < 1000) {
+				continue;
+			}
+			if (may_idle && idle_ns > 0 && now_ns() - since > idle_ns) {
+				cout << "Closing " << channel->name() << " after being idle for " << idle_ns / 1000000000 << " s" << endl;
+				return false;
+			}
+			if (spins < 2000) {
+				sched_yield();
+			}
+			else {
+				usleep(50);
+			}
+		}
+		return false;
+	}
+	while (!stopping) {
+		if (channel->can_read()) {
+			return true;  // already read ahead, the descriptor may never show it
+		}
+		struct pollfd p = {fd, POLLIN, 0};
+		int n = poll(&p, 1, 100);  // wakes up to notice a shutdown
+		if (n > 0 || (n < 0 && errno != EINTR)) {
+			return true;  // a request, a hangup or an error, which cread then reports
+		}
+		if (may_idle && idle_ns > 0 && now_ns() - since > idle_ns) {
+			cout << "Closing " << channel->name() << " after being idle for " << idle_ns / 1000000000 << " s" << endl;
+			return false;
+		}
+	}
+	return false;
+}
+
+void ChannelRegistry::shutdown () {
+	stopping = true;
+	join_workers(true);
+}
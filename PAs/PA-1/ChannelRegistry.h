@@ -0,0 +1,71 @@
+#ifndef _ChannelRegistry_H_
+#define _ChannelRegistry_H_
+
+#include "RequestChannel.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+
+class ChannelRegistry {
+private:
+	/* Keeps track of the server's data channels. Names come from an atomic counter, so
+	 concurrent NEWCHANNEL_MSGs never hand out the same one, and at most max_channels are
+	 open at a time. In the threaded mode every channel's thread is owned here: finished
+	 threads are joined whenever a new one starts, so threads, descriptors and memory stay
+	 flat however many channels come and go, and shutdown() joins the rest instead of
+	 leaving detached threads running into the end of main. */
+	struct Worker {
+		std::thread th;
+		std::atomic<bool> done;
+		Worker () : done(false) {}
+	};
+
+	std::atomic<int> next_id;
+	std::atomic<int> live;
+	std::atomic<bool> stopping;
+	int max_channels;     // 0 for no limit
+	uint64_t idle_ns;     // 0 for no idle timeout
+
+	std::mutex mtx;       // guards workers
+	std::list<Worker*> workers;
+
+	void join_workers (bool all);
+
+public:
+	ChannelRegistry ();
+	~ChannelRegistry ();
+
+	void set_limits (int _max_channels, int idle_seconds);
+	/* call before the first channel is opened */
+
+	int allocate_id () { return ++next_id; }
+
+	bool admit ();
+	/* takes one of the max_channels places for a new channel, false if all are taken */
+
+	void release () { live--; }
+	/* gives the place back once the channel is closed */
+
+	int open_channels () const { return live.load(); }
+
+	void spawn (std::function<void()> serve);
+	/* runs serve on a thread of its own that is joined after it returns */
+
+	bool wait_for_request (RequestChannel* channel, bool may_idle);
+	/* Waits until a request can be read from the channel. Returns false if the channel was
+	 idle for longer than the idle timeout (only if may_idle) or the server is shutting
+	 down. Shared memory channels have no descriptor to wait on; they are checked with
+	 can_read, spinning first and then sleeping 50 us at a time. */
+
+	bool stopped () const { return stopping; }
+
+	void shutdown ();
+	/* makes every waiting channel thread give up and joins all of them */
+};
+
+#endif
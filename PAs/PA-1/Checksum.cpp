@@ -0,0 +1,59 @@
+#include "Checksum.h"
+
+#include <string.h>
+
+
+static const int CHECKSUM_LANES = 8;
+static const uint32_t P32_1 = 2654435761u, P32_2 = 2246822519u, P32_3 = 3266489917u;
+static const uint64_t P64_1 = 11400714785074694791ull, P64_2 = 14029467366897019727ull, P64_3 = 1609587929392839161ull;
+
+static inline uint32_t rotl32 (uint32_t v, int r) {
+	return (v << r) | (v >> (32 - r));
+}
+
+static inline uint64_t rotl64 (uint64_t v, int r) {
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t mix64 (uint64_t h) {
+	h ^= h >> 33;
+	h *= P64_2;
+	h ^= h >> 29;
+	h *= P64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t chunk_checksum (const void* data, size_t len) {
+	const unsigned char* p = (const unsigned char*) data;
+	const size_t stripe = CHECKSUM_LANES * sizeof(uint32_t);
+	uint32_t acc[CHECKSUM_LANES];
+	for (int i = 0; i < CHECKSUM_LANES; i++) {
+		acc[i] = P32_1 * (i + 1) + P32_2;
+	}
+	size_t n = len - len % stripe;
+	for (size_t off = 0; off < n; off += stripe) {
+		uint32_t in[CHECKSUM_LANES];
+		memcpy(in, p + off, stripe);  // the chunk has no alignment, and x86 and ARM are little-endian
+		// no lane depends on another, so this loop is one vector step per stripe
+		for (int i = 0; i < CHECKSUM_LANES; i++) {
+			acc[i] = rotl32(acc[i] + in[i] * P32_2, 13) * P32_1;
+		}
+	}
+
+	uint64_t h = (uint64_t) len * P64_1;
+	for (int i = 0; i < CHECKSUM_LANES; i += 2) {
+		h = rotl64(h ^ mix64(((uint64_t) acc[i] << 32) | acc[i + 1]), 27) * P64_1 + P64_2;
+	}
+	// the tail of fewer than a stripe, eight bytes at a time and then byte by byte
+	size_t off = n;
+	for (; off + sizeof(uint64_t) <= len; off += sizeof(uint64_t)) {
+		uint64_t v;
+		memcpy(&v, p + off, sizeof(v));
+		h = rotl64(h ^ (v * P64_2), 31) * P64_1;
+	}
+	for (; off < len; off++) {
+		h = rotl64(h ^ (p[off] * P64_3), 11) * P64_1;
+	}
+	return mix64(h);
+}
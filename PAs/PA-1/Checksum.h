@@ -0,0 +1,15 @@
+#ifndef _Checksum_H_
+#define _Checksum_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+uint64_t chunk_checksum (const void* data, size_t len);
+/* A 64-bit hash of len bytes, the same on the client and the server, to tell a chunk that
+ arrived intact from one that did not. It is not meant to hold up against someone making
+ collisions on purpose. The bulk of the data goes through eight independent 32-bit
+ lanes of the XXH32 round, which the compiler turns into vector multiplies, and the lanes
+ are then folded into 64 bits. */
+
+#endif
@@ -0,0 +1,84 @@
+#include "ChunkCache.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+
+size_t ChunkKeyHash::operator() (const ChunkKey& k) const {
+	// boost::hash_combine over the fields
+	size_t h = 0;
+	for (uint64_t v : {k.dev, k.ino, (uint64_t) k.mtime_ns, (uint64_t) k.offset, (uint64_t) k.length}) {
+		h ^= hash<uint64_t>()(v) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	}
+	return h;
+}
+
+/*--------------------------------------------------------------------------*/
+/*			MEMBER FUNCTIONS FOR CLASS	C h u n k C a c h e				*/
+/*--------------------------------------------------------------------------*/
+
+ChunkCache::ChunkCache () : shard_capacity(0), n_hits(0), n_misses(0), n_evictions(0) {}
+
+void ChunkCache::set_capacity (size_t bytes) {
+	shard_capacity = bytes / NUM_SHARDS;
+}
+
+ChunkCache::Shard& ChunkCache::shard_of (const ChunkKey& key) {
+	return shards[ChunkKeyHash()(key) % NUM_SHARDS];
+}
+
+ChunkCache::Chunk ChunkCache::get (const ChunkKey& key) {
+	Shard& s = shard_of(key);
+	lock_guard<mutex> lock(s.mtx);
+	auto it = s.index.find(key);
+	if (it == s.index.end()) {
+		n_misses.fetch_add(1, memory_order_relaxed);
+		return Chunk();
+	}
+	s.lru.splice(s.lru.begin(), s.lru, it->second);
+	n_hits.fetch_add(1, memory_order_relaxed);
+	return it->second->data;
+}
+
+void ChunkCache::put (const ChunkKey& key, const char* data, int length) {
+	if (length <= 0 || (size_t) length > shard_capacity) {
+		return;
+	}
+	// the copy is made before taking the lock
+	Chunk chunk = make_shared<const vector<char>>(data, data + length);
+
+	Shard& s = shard_of(key);
+	lock_guard<mutex> lock(s.mtx);
+	if (s.index.count(key)) {
+		return;  // another thread cached it first
+	}
+	while (s.bytes + length > shard_capacity) {
+		Entry& last = s.lru.back();
+		s.bytes -= last.data->size();
+		s.index.erase(last.key);
+		s.lru.pop_back();
+		n_evictions.fetch_add(1, memory_order_relaxed);
+	}
+	s.lru.push_front({key, chunk});
+	s.index[key] = s.lru.begin();
+	s.bytes += length;
+}
+
+string ChunkCache::report () {
+	size_t bytes = 0;
+	for (Shard& s : shards) {
+		lock_guard<mutex> lock(s.mtx);
+		bytes += s.bytes;
+	}
+	uint64_t hits = n_hits.load(memory_order_relaxed), misses = n_misses.load(memory_order_relaxed);
+	ostringstream out;
+	out << "chunk cache: " << hits << " hits, " << misses << " misses";
+	if (hits + misses) {
+		out << fixed << setprecision(1) << " (" << 100.0 * hits / (hits + misses) << "% hit rate)";
+	}
+	out << ", " << n_evictions.load(memory_order_relaxed) << " evictions, " << bytes << " of "
+		<< shard_capacity * NUM_SHARDS << " bytes in use" << endl;
+	return out.str();
+}
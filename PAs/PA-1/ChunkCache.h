@@ -0,0 +1,80 @@
+#ifndef _ChunkCache_H_
+#define _ChunkCache_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+
+struct ChunkKey {
+	/* A chunk of one version of a file: device, inode and modification time tell a
+	 rewritten file apart from the one whose chunks are cached, even under the same name. */
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime_ns;
+	__int64_t offset;
+	int length;
+
+	bool operator== (const ChunkKey& o) const {
+		return dev == o.dev && ino == o.ino && mtime_ns == o.mtime_ns && offset == o.offset && length == o.length;
+	}
+};
+
+struct ChunkKeyHash {
+	size_t operator() (const ChunkKey& k) const;
+};
+
+
+class ChunkCache {
+public:
+	typedef std::shared_ptr<const std::vector<char>> Chunk;
+
+private:
+	/* Every key belongs to one of NUM_SHARDS shards, each an LRU list with its own lock
+	 and an equal part of the capacity, so concurrent requests rarely wait for each other.
+	 A chunk is handed out as a shared_ptr and stays valid while it is being sent, even
+	 if it is evicted meanwhile. */
+	static const int NUM_SHARDS = 16;
+
+	struct Entry {
+		ChunkKey key;
+		Chunk data;
+	};
+	struct Shard {
+		std::mutex mtx;
+		std::list<Entry> lru;  // most recently used first
+		std::unordered_map<ChunkKey, std::list<Entry>::iterator, ChunkKeyHash> index;
+		size_t bytes = 0;
+	};
+
+	Shard shards[NUM_SHARDS];
+	size_t shard_capacity;
+	std::atomic<uint64_t> n_hits, n_misses, n_evictions;
+
+	Shard& shard_of (const ChunkKey& key);
+
+public:
+	ChunkCache ();
+
+	void set_capacity (size_t bytes);
+	/* 0 (the default) turns the cache off; call it before the first request */
+
+	bool enabled () const { return shard_capacity > 0; }
+
+	Chunk get (const ChunkKey& key);
+	/* the cached chunk, or an empty pointer after a miss */
+
+	void put (const ChunkKey& key, const char* data, int length);
+	/* caches a copy of the chunk, evicting the least recently used chunks of its shard;
+	 chunks larger than a shard are not cached */
+
+	std::string report ();
+	/* one line with hits, misses, evictions and the bytes in use */
+};
+
+#endif
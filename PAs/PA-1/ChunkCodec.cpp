@@ -0,0 +1,489 @@
+#include "ChunkCodec.h"
+#include "common.h"
+
+#include <algorithm>
+#include <charconv>
+
+using namespace std;
+
+
+/* LZ codec: a hash of the next 4 bytes finds the last position that started with them,
+and a match of at least MIN_MATCH bytes within 64 KiB becomes a sequence. */
+
+static const int MIN_MATCH = 4;
+static const int HASH_BITS = 12;
+
+static inline uint32_t read32 (const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash32 (uint32_t v) {
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// the rest of a length above 15: as many 255s as it takes and then what is left
+static uint8_t* put_length (uint8_t* out, const uint8_t* end, int n) {
+	for (; n >= 255; n -= 255) {
+		if (out >= end) {
+			return NULL;
+		}
+		*out++ = 255;
+	}
+	if (out >= end) {
+		return NULL;
+	}
+	*out++ = n;
+	return out;
+}
+
+static bool get_length (const uint8_t*& in, const uint8_t* end, int& n) {
+	uint8_t b;
+	do {
+		if (in >= end || n > (1 << 30)) {
+			return false;
+		}
+		b = *in++;
+		n += b;
+	} while (b == 255);
+	return true;
+}
+
+// one sequence: the literals and then a match of mlen bytes at offset; the last has no match
+static uint8_t* put_sequence (uint8_t* out, const uint8_t* end, const uint8_t* lit, int litlen, int offset, int mlen) {
+	if (out >= end) {
+		return NULL;
+	}
+	uint8_t* token = out++;
+	*token = min(litlen, 15) << 4;
+	if (litlen >= 15 && !(out = put_length(out, end, litlen - 15))) {
+		return NULL;
+	}
+	if (end - out < litlen) {
+		return NULL;
+	}
+	memcpy(out, lit, litlen);
+	out += litlen;
+	if (mlen == 0) {
+		return out;
+	}
+	if (end - out < 2) {
+		return NULL;
+	}
+	*out++ = offset & 0xff;
+	*out++ = offset >> 8;
+	*token |= min(mlen - MIN_MATCH, 15);
+	if (mlen - MIN_MATCH >= 15 && !(out = put_length(out, end, mlen - MIN_MATCH - 15))) {
+		return NULL;
+	}
+	return out;
+}
+
+// returns the packed size, or -1 if it would not fit into cap bytes
+static int lz_pack (const uint8_t* src, int len, uint8_t* dst, int cap) {
+	int table[1 << HASH_BITS];
+	memset(table, 0xff, sizeof(table));  // -1: no position yet
+	uint8_t* out = dst;
+	const uint8_t* end = dst + cap;
+	int anchor = 0, ip = 0;
+	while (ip + MIN_MATCH <= len) {
+		uint32_t h = hash32(read32(src + ip));
+		int ref = table[h];
+		table[h] = ip;
+		if (ref < 0 || ip - ref > 65535 || read32(src + ref) != read32(src + ip)) {
+			ip++;
+			continue;
+		}
+		int mlen = MIN_MATCH;
+		while (ip + mlen < len && src[ref + mlen] == src[ip + mlen]) {
+			mlen++;
+		}
+		if (!(out = put_sequence(out, end, src + anchor, ip - anchor, ip - ref, mlen))) {
+			return -1;
+		}
+		ip += mlen;
+		anchor = ip;
+	}
+	out = put_sequence(out, end, src + anchor, len - anchor, 0, 0);
+	return out ? out - dst : -1;
+}
+
+static int lz_unpack (const uint8_t* in, const uint8_t* end, uint8_t* dst, int len) {
+	int op = 0;
+	while (in < end) {
+		uint8_t token = *in++;
+		int litlen = token >> 4;
+		if (litlen == 15 && !get_length(in, end, litlen)) {
+			return -1;
+		}
+		if (end - in < litlen || len - op < litlen) {
+			return -1;
+		}
+		memcpy(dst + op, in, litlen);
+		in += litlen;
+		op += litlen;
+		if (in == end) {
+			break;  // the last sequence
+		}
+		if (end - in < 2) {
+			return -1;
+		}
+		int offset = in[0] | (in[1] << 8);
+		in += 2;
+		int mlen = token & 15;
+		if (mlen == 15 && !get_length(in, end, mlen)) {
+			return -1;
+		}
+		mlen += MIN_MATCH;
+		if (offset == 0 || offset > op || len - op < mlen) {
+			return -1;
+		}
+		// byte by byte, a match may overlap the bytes it produces
+		for (int i = 0; i < mlen; i++, op++) {
+			dst[op] = dst[op - offset];
+		}
+	}
+	return op;
+}
+
+
+/* Numeric codec: a record starts with a tag byte. 0 is a run of raw bytes with its varint
+length. Otherwise the low bits are the number of columns (1 to MAX_COLUMNS) and the high
+bits say how the numbers are printed: FORMAT_CANONICAL without trailing zeros after the
+point, FORMAT_PREVIOUS with the decimal places of the last line that gave them, and
+FORMAT_NEW with those places given in one byte per column. The varints follow. */
+
+static const int MAX_COLUMNS = 15;
+static const int MAX_PLACES = 6;
+static const int MAX_INT_DIGITS = 12;  // with MAX_PLACES, every value fits an int64_t
+static const int64_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+static const int FORMAT_CANONICAL = 0x00, FORMAT_PREVIOUS = 0x10, FORMAT_NEW = 0x20;
+
+/* Parses one decimal without leading zeros and other than "-0" into units of 10^-places.
+canonical tells if it also has no trailing zeros after the point. Returns the position
+after it, or NULL. */
+static const char* parse_decimal (const char* p, const char* end, int64_t& units, int& places, bool& canonical) {
+	bool negative = (p < end && *p == '-');
+	p += negative;
+	const char* digits = p;
+	int64_t whole = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (p - digits >= MAX_INT_DIGITS) {
+			return NULL;
+		}
+		whole = whole * 10 + (*p - '0');
+	}
+	if (p == digits || (p - digits > 1 && *digits == '0')) {
+		return NULL;
+	}
+	int64_t frac = 0;
+	places = 0;
+	canonical = true;
+	if (p < end && *p == '.') {
+		const char* first = ++p;
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (p - first >= MAX_PLACES) {
+				return NULL;
+			}
+			frac = frac * 10 + (*p - '0');
+		}
+		places = p - first;
+		if (places == 0) {
+			return NULL;
+		}
+		canonical = (p[-1] != '0');
+	}
+	if (negative && whole == 0 && frac == 0) {
+		return NULL;
+	}
+	units = whole * POW10[places] + frac;
+	units = negative ? -units : units;
+	return p;
+}
+
+// a line "number,number,...\n"; returns the position after the newline, or NULL
+static const char* parse_line (const char* p, const char* end, int64_t* units, int* places, bool& canonical, int& ncols) {
+	ncols = 0;
+	canonical = true;
+	while (ncols < MAX_COLUMNS) {
+		bool c;
+		if (!(p = parse_decimal(p, end, units[ncols], places[ncols], c))) {
+			return NULL;
+		}
+		canonical = canonical && c;
+		ncols++;
+		if (p < end && *p == '\n') {
+			return p + 1;
+		}
+		if (p >= end || *p != ',') {
+			return NULL;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+// v in units of 10^-unit_places, with places digits after the point or, if places < 0, as few as it takes
+static char* render_decimal (char* out, int64_t v, int unit_places, int places) {
+	if (v < 0) {
+		*out++ = '-';
+		v = -v;
+	}
+	out = to_chars(out, out + 20, v / POW10[unit_places]).ptr;
+	int64_t frac = v % POW10[unit_places];
+	if (places < 0) {
+		places = unit_places;
+		for (; places > 0 && frac % 10 == 0; places--) {
+			frac /= 10;
+		}
+	}
+	else {
+		frac /= POW10[unit_places - places];
+	}
+	if (places > 0) {
+		*out++ = '.';
+		for (int i = places - 1; i >= 0; i--) {
+			out[i] = '0' + frac % 10;
+			frac /= 10;
+		}
+		out += places;
+	}
+	return out;
+}
+
+static uint8_t* put_varint (uint8_t* out, const uint8_t* end, uint64_t v) {
+	do {
+		if (out >= end) {
+			return NULL;
+		}
+		*out++ = (v & 0x7f) | (v >= 0x80 ? 0x80 : 0);
+		v >>= 7;
+	} while (v);
+	return out;
+}
+
+static bool get_varint (const uint8_t*& in, const uint8_t* end, uint64_t& v) {
+	v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (in >= end) {
+			return false;
+		}
+		uint8_t b = *in++;
+		v |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint8_t* put_raw (uint8_t* out, const uint8_t* end, const char* raw, int n) {
+	if (n == 0) {
+		return out;
+	}
+	if (out >= end) {
+		return NULL;
+	}
+	*out++ = 0;
+	if (!(out = put_varint(out, end, n)) || end - out < n) {
+		return NULL;
+	}
+	memcpy(out, raw, n);
+	return out + n;
+}
+
+static int numeric_pack (const char* src, int len, uint8_t* dst, int cap) {
+	const char* end = src + len;
+	int64_t units[MAX_COLUMNS];
+	int places[MAX_COLUMNS];
+	bool canonical;
+	int ncols;
+
+	// the unit of the chunk is the smallest decimal place of any of its numbers
+	int unit_places = 0;
+	for (const char* p = src; p < end; ) {
+		const char* next = parse_line(p, end, units, places, canonical, ncols);
+		if (next) {
+			unit_places = max(unit_places, *max_element(places, places + ncols));
+			p = next;
+		}
+		else {
+			const char* nl = (const char*) memchr(p, '\n', end - p);
+			p = nl ? nl + 1 : end;
+		}
+	}
+
+	uint8_t* out = dst;
+	const uint8_t* out_end = dst + cap;
+	if (out >= out_end) {
+		return -1;
+	}
+	*out++ = unit_places;
+	int64_t prev[MAX_COLUMNS] = {0};
+	int prev_cols = 0;
+	int format[MAX_COLUMNS];
+	int format_cols = 0;  // the places of the last line that gave them
+	const char* raw = src;  // start of the raw bytes not written yet
+	for (const char* p = src; p < end; ) {
+		const char* next = parse_line(p, end, units, places, canonical, ncols);
+		if (!next) {
+			const char* nl = (const char*) memchr(p, '\n', end - p);
+			p = nl ? nl + 1 : end;
+			continue;
+		}
+		if (!(out = put_raw(out, out_end, raw, p - raw)) || out >= out_end) {
+			return -1;
+		}
+		if (ncols != prev_cols) {
+			memset(prev, 0, sizeof(prev));
+			prev_cols = ncols;
+		}
+		if (canonical) {
+			*out++ = FORMAT_CANONICAL | ncols;
+		}
+		else if (ncols == format_cols && equal(places, places + ncols, format)) {
+			*out++ = FORMAT_PREVIOUS | ncols;
+		}
+		else {
+			if (out_end - out < 1 + ncols) {
+				return -1;
+			}
+			*out++ = FORMAT_NEW | ncols;
+			for (int i = 0; i < ncols; i++) {
+				*out++ = format[i] = places[i];
+			}
+			format_cols = ncols;
+		}
+		for (int i = 0; i < ncols; i++) {
+			int64_t v = units[i] * POW10[unit_places - places[i]];
+			int64_t d = v - prev[i];
+			prev[i] = v;
+			if (!(out = put_varint(out, out_end, ((uint64_t) d << 1) ^ (uint64_t) (d >> 63)))) {
+				return -1;
+			}
+		}
+		p = raw = next;
+	}
+	if (!(out = put_raw(out, out_end, raw, end - raw))) {
+		return -1;
+	}
+	return out - dst;
+}
+
+static int numeric_unpack (const uint8_t* in, const uint8_t* end, char* dst, int len) {
+	if (in >= end || *in > MAX_PLACES) {
+		return -1;
+	}
+	int unit_places = *in++;
+	int64_t limit = POW10[MAX_PLACES] * 1000000000000LL;  // MAX_INT_DIGITS
+	int64_t prev[MAX_COLUMNS] = {0};
+	int prev_cols = 0;
+	int format[MAX_COLUMNS];
+	int format_cols = 0;
+	int op = 0;
+	while (in < end) {
+		int tag = *in++;
+		uint64_t n;
+		if (tag == 0) {
+			if (!get_varint(in, end, n) || n > (uint64_t) (end - in) || n > (uint64_t) (len - op)) {
+				return -1;
+			}
+			memcpy(dst + op, in, n);
+			in += n;
+			op += n;
+			continue;
+		}
+		int ncols = tag & 0x0f;
+		int how = tag & ~0x0f;
+		if (ncols == 0 || how > FORMAT_NEW || (how == FORMAT_PREVIOUS && ncols != format_cols)) {
+			return -1;
+		}
+		if (how == FORMAT_NEW) {
+			if (end - in < ncols) {
+				return -1;
+			}
+			for (int i = 0; i < ncols; i++) {
+				format[i] = *in++;
+				if (format[i] > unit_places) {
+					return -1;
+				}
+			}
+			format_cols = ncols;
+		}
+		if (ncols != prev_cols) {
+			memset(prev, 0, sizeof(prev));
+			prev_cols = ncols;
+		}
+		for (int i = 0; i < ncols; i++) {
+			if (!get_varint(in, end, n)) {
+				return -1;
+			}
+			int64_t d = (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+			int64_t v = (int64_t) ((uint64_t) prev[i] + (uint64_t) d);
+			if (v <= -limit || v >= limit) {
+				return -1;
+			}
+			prev[i] = v;
+			char text[32];
+			char* text_end = render_decimal(text, v, unit_places, how == FORMAT_CANONICAL ? -1 : format[i]);
+			*text_end++ = (i + 1 < ncols) ? ',' : '\n';
+			if (text_end - text > len - op) {
+				return -1;
+			}
+			memcpy(dst + op, text, text_end - text);
+			op += text_end - text;
+		}
+	}
+	return op;
+}
+
+
+int pack_chunk (const char* src, int len, char* dst) {
+	/* the numeric codec goes first since it is cheap to rule out: on other data every line
+	is raw and it gives up once it is as large as the chunk */
+	uint8_t* out = (uint8_t*) dst + 1;
+	int packed = numeric_pack(src, len, out, len);
+	ChunkCodec codec = CODEC_NUMERIC;
+	if (packed < 0 || packed > len / 3) {
+		// the LZ codec only gets a try if it may do better; it needs its own buffer for it
+		thread_local vector<uint8_t> scratch;
+		if ((int) scratch.size() < len) {
+			scratch.resize(len);
+		}
+		int lz = lz_pack((const uint8_t*) src, len, scratch.data(), packed < 0 ? len : packed);
+		if (lz >= 0 && (packed < 0 || lz < packed)) {
+			memcpy(out, scratch.data(), lz);
+			packed = lz;
+			codec = CODEC_LZ;
+		}
+	}
+	if (packed < 0 || packed >= len) {
+		memcpy(out, src, len);
+		packed = len;
+		codec = CODEC_STORED;
+	}
+	dst[0] = codec;
+	return packed + 1;
+}
+
+int unpack_chunk (const char* src, int packed, char* dst, int len) {
+	if (packed < 1) {
+		return -1;
+	}
+	const uint8_t* in = (const uint8_t*) src + 1;
+	const uint8_t* end = (const uint8_t*) src + packed;
+	switch (src[0]) {
+		case CODEC_STORED:
+			if (packed - 1 > len) {
+				return -1;
+			}
+			memcpy(dst, in, packed - 1);
+			return packed - 1;
+		case CODEC_LZ:
+			return lz_unpack(in, end, (uint8_t*) dst, len);
+		case CODEC_NUMERIC:
+			return numeric_unpack(in, end, dst, len);
+	}
+	return -1;
+}
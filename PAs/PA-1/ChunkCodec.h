@@ -0,0 +1,33 @@
+#ifndef _ChunkCodec_H_
+#define _ChunkCodec_H_
+
+#include <stdint.h>
+
+
+/* Compression of single file chunks for FILEZ_MSG. Every chunk is packed on its own, so
+ any chunk of a file can be requested and unpacked without the others, in any order and
+ over any channel. A packed chunk starts with one byte naming its codec:
+	CODEC_STORED   the bytes as they are, when nothing else is smaller
+	CODEC_LZ       LZ77 in the LZ4 block layout: a token with the literal and the match
+	               length, the literals, a 2-byte offset and the rest of the match length
+	CODEC_NUMERIC  lines of comma-separated decimals such as "0.004,0.68,-1.28", each
+	               number as the zigzag varint of its difference to the same column of
+	               the line before, in units of the chunk's smallest decimal place. A
+	               line is printed back either as short as possible or with the decimal
+	               places it had, such as "0.000,0.540"; lines that neither gives back
+	               exactly, and the partial lines at both ends of a chunk, are kept as
+	               they are. */
+enum ChunkCodec : uint8_t {CODEC_STORED, CODEC_LZ, CODEC_NUMERIC};
+
+inline int pack_bound (int len) { return len + 1; }
+/* the most bytes pack_chunk produces for len bytes */
+
+int pack_chunk (const char* src, int len, char* dst);
+/* Packs len bytes of src into dst, which has room for pack_bound(len) bytes, with the
+ codec that gives the fewest bytes. Returns the packed size. */
+
+int unpack_chunk (const char* src, int packed, char* dst, int len);
+/* Unpacks a chunk of packed bytes into dst of len bytes. Returns the unpacked size, or
+ -1 if the chunk is damaged or would not fit. */
+
+#endif
@@ -0,0 +1,171 @@
+#include "CorePlacement.h"
+#include "common.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <sstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+
+/* Parses a list such as "0-3,8" as in sysfs and taskset; false if it is not one or names
+a CPU at or above limit. The bound is checked before a range is expanded, so a list like
+0-2000000000 fails at once instead of filling memory. */
+static bool parse_cpu_list (const string& list, vector<int>& out, int limit) {
+	for (const string& item : split(list, ',')) {
+		int first, last;
+		char extra;
+		if (sscanf(item.c_str(), "%d-%d%c", &first, &last, &extra) == 2) {
+			if (first < 0 || last < first) {
+				return false;
+			}
+		}
+		else if (sscanf(item.c_str(), "%d%c", &first, &extra) == 1 && first >= 0) {
+			last = first;
+		}
+		else {
+			return false;
+		}
+		if (last >= limit) {
+			return false;
+		}
+		for (int cpu = first; cpu <= last; cpu++) {
+			out.push_back(cpu);
+		}
+	}
+	return !out.empty();
+}
+
+static string join (const vector<int>& values) {
+	stringstream ss;
+	for (size_t i = 0; i < values.size(); i++) {
+		ss << (i ? "," : "") << values[i];
+	}
+	return ss.str();
+}
+
+bool CorePlacement::configure (const string& spec) {
+#ifdef __linux__
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+		EXITONERROR("sched_getaffinity");
+	}
+	cpus.clear();
+	if (spec == "all") {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &allowed)) {
+				cpus.push_back(cpu);
+			}
+		}
+	}
+	else if (!parse_cpu_list(spec, cpus, CPU_SETSIZE)) {
+		cerr << "Cannot parse the CPU list " << spec << ", use all or a list like 0-3,8 of CPUs below " << CPU_SETSIZE << endl;
+		cpus.clear();
+		return false;
+	}
+	for (int cpu : cpus) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			cerr << "CPU " << cpu << " is not one the server may run on" << endl;
+			cpus.clear();
+			return false;
+		}
+	}
+
+	// every NUMA node with CPUs of the set; without sysfs they all count as node 0
+	nodes.clear();
+	vector<int> placed;
+	DIR* dir = opendir("/sys/devices/system/node");
+	struct dirent* entry;
+	while (dir && (entry = readdir(dir))) {
+		int id;
+		char extra;
+		if (sscanf(entry->d_name, "node%d%c", &id, &extra) != 1) {
+			continue;
+		}
+		ifstream in("/sys/devices/system/node/" + string(entry->d_name) + "/cpulist");
+		string list;
+		vector<int> node_cpus;
+		if (!getline(in, list) || !parse_cpu_list(list, node_cpus, CPU_SETSIZE)) {
+			continue;
+		}
+		Node node = {id, {}};
+		for (int cpu : cpus) {
+			if (find(node_cpus.begin(), node_cpus.end(), cpu) != node_cpus.end()) {
+				node.cpus.push_back(cpu);
+				placed.push_back(cpu);
+			}
+		}
+		if (!node.cpus.empty()) {
+			nodes.push_back(node);
+		}
+	}
+	if (dir) {
+		closedir(dir);
+	}
+	sort(nodes.begin(), nodes.end(), [] (const Node& a, const Node& b) { return a.id < b.id; });
+	if (placed.size() != cpus.size()) {
+		nodes.assign(1, {0, cpus});  // sysfs is missing or does not list some of the CPUs
+	}
+	return true;
+#else
+	(void) spec;
+	cerr << "Pinning threads to CPUs needs Linux" << endl;
+	return false;
+#endif
+}
+
+bool CorePlacement::pin (const vector<int>& set) {
+#ifdef __linux__
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	for (int cpu : set) {
+		CPU_SET(cpu, &mask);
+	}
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+	if (err != 0) {
+		cerr << "Could not pin a thread to CPUs " << join(set) << ": " << strerror(err) << endl;
+		return false;
+	}
+	return true;
+#else
+	(void) set;
+	return false;
+#endif
+}
+
+void CorePlacement::pin_all () {
+	if (enabled()) {
+		pin(cpus);
+	}
+}
+
+int CorePlacement::pin_thread () {
+	if (!enabled()) {
+		return -1;
+	}
+	int cpu = cpus[next++ % cpus.size()];
+	return pin({cpu}) ? cpu : -1;
+}
+
+void CorePlacement::pin_person (int person) {
+	if (enabled()) {
+		pin(nodes[(person - 1) % nodes.size()].cpus);
+	}
+}
+
+string CorePlacement::layout () const {
+	stringstream ss;
+	ss << "Pinning channel threads to CPUs " << join(cpus) << ", one CPU each in turn" << endl;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		vector<int> persons;
+		for (int person = i + 1; person <= NUM_PERSONS; person += nodes.size()) {
+			persons.push_back(person);
+		}
+		ss << "  node " << nodes[i].id << ": CPUs " << join(nodes[i].cpus) << ", data of persons " << join(persons) << endl;
+	}
+	return ss.str();
+}
@@ -0,0 +1,51 @@
+#ifndef _CorePlacement_H_
+#define _CorePlacement_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+class CorePlacement {
+private:
+	/* Where the server's threads run (server -A). Without it every thread may run on any
+	 CPU. With a set of CPUs, every channel thread and every event-driven worker is pinned
+	 to one CPU of the set, taking them in turn, so a thread keeps its caches and never
+	 moves to the other socket. The NUMA nodes come from sysfs; the persons are dealt out
+	 over the nodes that have CPUs in the set, and each person is loaded by a thread pinned
+	 to its node, so the kernel's first-touch policy puts its samples in that node's
+	 memory. Pinning needs Linux; elsewhere configure() fails. */
+	struct Node {
+		int id;
+		std::vector<int> cpus;  // the CPUs of the set on this node
+	};
+
+	std::vector<int> cpus;  // the set, in the order threads are placed on it
+	std::vector<Node> nodes;
+	std::atomic<unsigned> next;
+
+	bool pin (const std::vector<int>& set);
+
+public:
+	CorePlacement () : next(0) {}
+
+	bool configure (const std::string& spec);
+	/* "all" for every CPU the server may use, or a list such as "0-3,8"; reports on cerr
+	 and returns false if the list cannot be parsed or names a CPU the server may not use */
+
+	bool enabled () const { return !cpus.empty(); }
+
+	void pin_all ();
+	/* pins the calling thread to the whole set; threads it starts inherit that */
+
+	int pin_thread ();
+	/* pins the calling thread to the next CPU of the set and returns it, -1 if disabled */
+
+	void pin_person (int person);
+	/* pins the calling thread to the CPUs of the node that holds the person */
+
+	std::string layout () const;
+	/* the CPUs, the nodes and the persons on each, for the startup log */
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "DataClient.h"
+
+#include <sstream>
+
+using namespace std;
+
+
+DataClient::DataClient (const vector<RequestChannel*>& channels, size_t cache_points)
+	: idle(channels), capacity(cache_points), n_queries(0), n_hits(0), n_coalesced(0), n_round_trips(0) {
+	index.reserve(cache_points);
+}
+
+double DataClient::get (int person, double seconds, int ecgno) {
+	return lookup(person, seconds).ecg[ecgno == 1 ? 0 : 1];
+}
+
+void DataClient::get_pair (int person, double seconds, double out[2]) {
+	Point pt = lookup(person, seconds);
+	out[0] = pt.ecg[0];
+	out[1] = pt.ecg[1];
+}
+
+DataClient::Point DataClient::lookup (int person, double seconds) {
+	long sample = lround(seconds / 0.004);
+	uint64_t key = ((uint64_t) (uint32_t) person << 32) | (uint32_t) sample;
+
+	unique_lock<mutex> lock(mtx);
+	n_queries++;
+	auto cached = index.find(key);
+	if (cached != index.end()) {
+		n_hits++;
+		lru.splice(lru.begin(), lru, cached->second);
+		return cached->second->second;
+	}
+	auto pending = inflight.find(key);
+	if (pending != inflight.end()) {
+		// someone else is fetching this point already, share their round trip
+		n_coalesced++;
+		shared_future<Point> result = pending->second;
+		lock.unlock();
+		return result.get();
+	}
+	promise<Point> result;
+	inflight[key] = result.get_future().share();
+	n_round_trips++;
+	lock.unlock();
+
+	Point pt = fetch(person, sample);
+	result.set_value(pt);
+
+	lock.lock();
+	inflight.erase(key);
+	if (capacity > 0 && index.find(key) == index.end()) {
+		lru.push_front(make_pair(key, pt));
+		index[key] = lru.begin();
+		if (lru.size() > capacity) {
+			index.erase(lru.back().first);
+			lru.pop_back();
+		}
+	}
+	return pt;
+}
+
+DataClient::Point DataClient::fetch (int person, long sample) {
+	RequestChannel* chan;
+	{
+		unique_lock<mutex> lock(mtx);
+		channel_free.wait(lock, [this] { return !idle.empty(); });
+		chan = idle.back();
+		idle.pop_back();
+	}
+
+	datapairmsg d(person, sample * 0.004);
+	Point pt = {{0.0, 0.0}};
+	chan->cwrite(&d, sizeof(datapairmsg));
+	if (chan->cread(pt.ecg, sizeof(pt.ecg)) != (int) sizeof(pt.ecg)) {
+		cerr << "Could not fetch the data of person " << person << " at sample " << sample << endl;
+	}
+
+	{
+		lock_guard<mutex> lock(mtx);
+		idle.push_back(chan);
+	}
+	channel_free.notify_one();
+	return pt;
+}
+
+string DataClient::report () {
+	lock_guard<mutex> lock(mtx);
+	ostringstream out;
+	out << "Data client: " << n_queries << " queries, " << n_hits << " cache hits, " << n_coalesced
+		<< " coalesced, " << n_round_trips << " round trips" << endl;
+	return out.str();
+}
@@ -0,0 +1,52 @@
+#ifndef _DataClient_H_
+#define _DataClient_H_
+
+#include "RequestChannel.h"
+
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+
+class DataClient {
+private:
+	/* Answers data queries for any number of threads over a pool of channels. A query
+	 for either ECG fetches both of its time with one DATA_PAIR_MSG, so the other ECG
+	 is already cached when it is asked for. Concurrent queries for a point that is
+	 being fetched wait for that round trip instead of starting their own, and the
+	 most recently used points are kept in an LRU cache. Points are keyed by patient
+	 and sample index, the same rounding the server applies to the seconds. */
+	struct Point {
+		double ecg[2];
+	};
+	typedef std::list<std::pair<uint64_t, Point>> Lru;  // most recently used first
+
+	std::mutex mtx;
+	std::condition_variable channel_free;
+	std::vector<RequestChannel*> idle;  // channels not in a round trip right now
+	size_t capacity;
+	Lru lru;
+	std::unordered_map<uint64_t, Lru::iterator> index;
+	std::unordered_map<uint64_t, std::shared_future<Point>> inflight;
+	uint64_t n_queries, n_hits, n_coalesced, n_round_trips;
+
+	Point lookup (int person, double seconds);
+	Point fetch (int person, long sample);
+
+public:
+	DataClient (const std::vector<RequestChannel*>& channels, size_t cache_points);
+	/* the channels stay owned by the caller; cache_points 0 turns the cache off */
+
+	double get (int person, double seconds, int ecgno);
+
+	void get_pair (int person, double seconds, double out[2]);
+	/* out[0] is ECG 1 and out[1] is ECG 2 */
+
+	std::string report ();
+	/* one line with the queries, how they were answered and the round trips they took */
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include "Export.h"
+
+#include <charconv>
+#include <climits>
+
+using namespace std;
+
+
+/*--------------------------------------------------------------------------*/
+/*		MEMBER FUNCTIONS FOR CLASS	B u f f e r e d W r i t e r				*/
+/*--------------------------------------------------------------------------*/
+
+BufferedWriter::BufferedWriter (int _fd, size_t capacity) : fd(_fd), buf(capacity), used(0), failed(false) {}
+
+BufferedWriter::~BufferedWriter () {
+	flush();
+}
+
+bool BufferedWriter::flush () {
+	size_t done = 0;
+	while (done < used && !failed) {
+		ssize_t n = ::write(fd, buf.data() + done, used - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			failed = true;
+			break;
+		}
+		done += n;
+	}
+	used = 0;
+	return !failed;
+}
+
+char* BufferedWriter::reserve (size_t len) {
+	if (used + len > buf.size()) {
+		flush();
+	}
+	return buf.data() + used;
+}
+
+void BufferedWriter::write (const void* data, size_t len) {
+	const char* p = (const char*) data;
+	while (len > 0) {
+		size_t part = min(len, buf.size());
+		memcpy(reserve(part), p, part);
+		commit(part);
+		p += part;
+		len -= part;
+	}
+}
+
+/*--------------------------------------------------------------------------*/
+/*			E X P O R T I N G   A   T I M E   R A N G E						*/
+/*--------------------------------------------------------------------------*/
+
+bool parse_patients (const string& list, vector<int>& persons) {
+	persons.clear();
+	if (list == "all") {
+		for (int p = 1; p <= NUM_PERSONS; p++) {
+			persons.push_back(p);
+		}
+		return true;
+	}
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		string item = list.substr(pos, comma == string::npos ? string::npos : comma - pos);
+		int first = 0, last = 0;
+		if (sscanf(item.c_str(), "%d-%d", &first, &last) == 1) {
+			last = first;
+		}
+		if (first < 1 || last > NUM_PERSONS || first > last) {
+			return false;
+		}
+		for (int p = first; p <= last; p++) {
+			persons.push_back(p);
+		}
+		if (comma == string::npos) {
+			break;
+		}
+		pos = comma + 1;
+	}
+	return !persons.empty();
+}
+
+void send_range_request (RequestChannel* chan, int person, long sample, int ecgno, int count) {
+	datarangemsg d(person, sample * 0.004, ecgno, count);
+	chan->cwrite(&d, sizeof(datarangemsg));
+}
+
+int read_range_reply (RequestChannel* chan, int count, double* out) {
+	// the count and the points land in place, the points straight in the caller's array
+	int n = 0;
+	struct iovec iov[2] = {{&n, sizeof(int)}, {out, count * sizeof(double)}};
+	int got = chan->creadv(iov, 2);
+	if (got < (int) sizeof(int) || n < 0 || n > count || got != (int) (sizeof(int) + n * sizeof(double))) {
+		return -1;
+	}
+	return n;
+}
+
+int request_summaries (RequestChannel* chan, int person, long sample, int ecgno, int count, int bucket, int capacity, ecg_summary* out, int& covered) {
+	aggregatemsg a(person, sample * 0.004, ecgno, count, bucket);
+	if (chan->cwrite(&a, sizeof(aggregatemsg)) != sizeof(aggregatemsg)) {
+		return -1;
+	}
+	int header[2] = {0, 0};
+	struct iovec iov[2] = {{header, sizeof(header)}, {out, capacity * sizeof(ecg_summary)}};
+	int got = chan->creadv(iov, 2);
+	int n = header[0];
+	if (got < (int) sizeof(header) || n < 0 || n > capacity || got != (int) (sizeof(header) + n * sizeof(ecg_summary))) {
+		return -1;
+	}
+	covered = header[1];
+	return n;
+}
+
+// appends "time,ecg1,ecg2" lines with the shortest text that reads back as the same doubles
+static void write_csv_rows (BufferedWriter& out, long sample, int n, const double* ecg1, const double* ecg2) {
+	const int MAX_ROW = 3 * 32;
+	for (int i = 0; i < n; i++) {
+		char* start = out.reserve(MAX_ROW);
+		char* end = start + MAX_ROW;
+		// sample / 250 rather than sample * 0.004, which prints e.g. 0.028000000000000004
+		char* p = to_chars(start, end, (sample + i) / 250.0).ptr;
+		*p++ = ',';
+		p = to_chars(p, end, ecg1[i]).ptr;
+		*p++ = ',';
+		p = to_chars(p, end, ecg2[i]).ptr;
+		*p++ = '\n';
+		out.commit(p - start);
+	}
+}
+
+__int64_t export_patient (RequestChannel* chan, int person, const ExportOptions& opt) {
+	string path = "received/export_" + to_string(person) + (opt.binary ? ".bin" : ".csv");
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path.c_str());
+		return -1;
+	}
+	long first = lround(max(opt.start, 0.0) / 0.004);
+	long end = (opt.duration < 0) ? LONG_MAX : first + lround(opt.duration / 0.004);
+	export_header hdr = {{'E', 'C', 'G', 'X'}, person, first * 0.004, 0.004, 0};
+
+	BufferedWriter out(fd);
+	if (opt.binary) {
+		out.write(&hdr, sizeof(hdr));  // the count is filled in at the end
+	}
+
+	// batches in flight, a ring of depth slots; each is two requests, which must all fit into the channel
+	int depth = max(opt.depth, 1);
+	if (chan->max_queued() > 0) {
+		depth = max(min(depth, chan->max_queued() / 2), 1);
+	}
+	vector<long> starts(depth);
+	vector<int> lengths(depth);
+	int head = 0, inflight = 0;
+	vector<double> ecg1(opt.batch), ecg2(opt.batch);
+	vector<double> pairs(opt.binary ? 2 * opt.batch : 0);
+
+	long next = first;
+	bool more = next < end;
+	while (more || inflight > 0) {
+		while (more && inflight < depth) {
+			int len = (int) min((long) opt.batch, end - next);
+			send_range_request(chan, person, next, 1, len);
+			send_range_request(chan, person, next, 2, len);
+			int slot = (head + inflight++) % depth;
+			starts[slot] = next;
+			lengths[slot] = len;
+			next += len;
+			more = next < end;
+		}
+
+		long sample = starts[head];
+		int len = lengths[head];
+		head = (head + 1) % depth;
+		inflight--;
+		int n1 = read_range_reply(chan, len, ecg1.data());
+		int n2 = read_range_reply(chan, len, ecg2.data());
+		if (n1 < 0 || n2 < 0) {
+			cerr << "Export of patient " << person << " failed at " << sample * 0.004 << " s" << endl;
+			out.flush();
+			close(fd);
+			return -1;
+		}
+		int n = min(n1, n2);
+		if (n < len) {
+			more = false;  // the recording ends here, the batches still in flight come back empty
+		}
+		if (opt.binary) {
+			for (int i = 0; i < n; i++) {
+				pairs[2 * i] = ecg1[i];
+				pairs[2 * i + 1] = ecg2[i];
+			}
+			out.write(pairs.data(), 2 * n * sizeof(double));
+		}
+		else {
+			write_csv_rows(out, sample, n, ecg1.data(), ecg2.data());
+		}
+		hdr.count += n;
+	}
+
+	bool ok = out.flush();
+	if (opt.binary) {
+		ok = ok && pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr);
+	}
+	close(fd);
+	return ok ? hdr.count : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef _Export_H_
+#define _Export_H_
+
+#include "RequestChannel.h"
+
+#include <string>
+#include <vector>
+
+
+class BufferedWriter {
+private:
+	/* Collects output in one large buffer and passes it to write(2) only when the buffer is
+	 full, instead of flushing after every line the way endl does. */
+	int fd;
+	std::vector<char> buf;
+	size_t used;
+	bool failed;
+
+public:
+	BufferedWriter (int _fd, size_t capacity = 1 << 20);
+	~BufferedWriter ();
+	/* flushes, but leaves the descriptor open */
+
+	void write (const void* data, size_t len);
+
+	char* reserve (size_t len);
+	/* room for up to len bytes (at most the capacity) at the end of the buffer, which the
+	 caller fills directly and then hands back with commit */
+	void commit (size_t len) { used += len; }
+
+	bool flush ();
+	/* writes out what is buffered; false if this or any earlier write failed */
+};
+
+
+// layout of a binary export (-B): this header, then count pairs of ecg1 and ecg2 doubles
+struct export_header {
+	char magic[4];      // "ECGX"
+	int person;
+	double start;       // seconds of the first sample
+	double period;      // seconds between two samples
+	__int64_t count;
+};
+
+struct ExportOptions {
+	double start;       // seconds
+	double duration;    // seconds, < 0 for everything up to the end of the recording
+	bool binary;        // export_header and doubles instead of CSV text
+	int batch;          // points per DATA_RANGE_MSG, see datarange_capacity
+	int depth;          // batches in flight on the channel
+};
+
+
+bool parse_patients (const std::string& list, std::vector<int>& persons);
+/* parses "all" or a comma-separated list of patients and ranges such as "1,4-6" */
+
+void send_range_request (RequestChannel* chan, int person, long sample, int ecgno, int count);
+
+int read_range_reply (RequestChannel* chan, int count, double* out);
+/* reads the reply to a DATA_RANGE_MSG for up to count points into out. Returns the
+ number of points, which is smaller than count at the end of the recording, or -1 if the
+ reply is broken. */
+
+int request_summaries (RequestChannel* chan, int person, long sample, int ecgno, int count, int bucket, int capacity, ecg_summary* out, int& covered);
+/* One AGGREGATE_MSG round trip for count points from sample on in buckets of bucket points
+ (0 for a single summary). out holds capacity summaries, see aggregate_capacity. Returns
+ the number of summaries and sets covered to the points they cover, or returns -1 if the
+ reply is broken. */
+
+__int64_t export_patient (RequestChannel* chan, int person, const ExportOptions& opt);
+/* Streams the samples of one patient in [start, start + duration) into
+ received/export_<person>.csv (time,ecg1,ecg2 lines like the BIMDC files) or .bin. Up to
+ depth batches are requested ahead of the replies, so the channel never sits idle while
+ the output is written. Returns the number of samples, or -1 on failure. */
+
+#endif
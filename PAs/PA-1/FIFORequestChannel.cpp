@@ -6,12 +6,18 @@ using namespace std;
 /*		CONSTRUCTOR/DESTRUCTOR FOR CLASS	R e q u e s t C h a n n e l		*/
 /*--------------------------------------------------------------------------*/
 
-FIFORequestChannel::FIFORequestChannel (const string _name, const Side _side) : my_name( _name), my_side(_side) {
+FIFORequestChannel::FIFORequestChannel (const string _name, const Side _side, const function<bool()>& give_up)
+	: RequestChannel(_name, _side), wfd(-1), rfd(-1), next_len(0), next_filled(0) {
 	pipe1 = "fifo_" + my_name + "1";
 	pipe2 = "fifo_" + my_name + "2";
 		
 	if (_side == SERVER_SIDE) {
-		wfd = open_pipe(pipe1, O_WRONLY);
+		// the client opens pipe2 right after pipe1, so only the first open waits for it
+		wfd = open_pipe(pipe1, O_WRONLY, give_up);
+		if (wfd < 0) {
+			opened = false;
+			return;
+		}
 		rfd = open_pipe(pipe2, O_RDONLY);
 	}
 	else {
@@ -32,23 +38,190 @@ FIFORequestChannel::~FIFORequestChannel () {
 /*			MEMBER FUNCTIONS FOR CLASS	R e q u e s t C h a n n e l			*/
 /*--------------------------------------------------------------------------*/
 
-int FIFORequestChannel::open_pipe (string _pipe_name, int mode) {
+int FIFORequestChannel::pipe_size = 0;
+
+void FIFORequestChannel::set_pipe_size (int bytes) {
+	pipe_size = bytes;
+}
+
+int FIFORequestChannel::open_pipe (string _pipe_name, int mode, const function<bool()>& give_up) {
 	mkfifo (_pipe_name.c_str (), 0600);
-	int fd = open(_pipe_name.c_str(), mode);
+	int fd;
+	if (give_up) {
+		// a non-blocking open for writing fails with ENXIO until the other side opens the pipe
+		while ((fd = open(_pipe_name.c_str(), mode | O_NONBLOCK)) < 0 && errno == ENXIO) {
+			if (give_up()) {
+				return -1;
+			}
+			usleep(1000);
+		}
+		if (fd >= 0) {
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		}
+	}
+	else {
+		fd = open(_pipe_name.c_str(), mode);
+	}
 	if (fd < 0) {
 		EXITONERROR(_pipe_name);
 	}
+#ifdef F_SETPIPE_SZ
+	// both ends ask for the same size, so it does not matter which one comes first
+	if (pipe_size > 0 && fcntl(fd, F_SETPIPE_SZ, pipe_size) < 0) {
+		static bool warned = false;
+		if (!warned) {
+			warned = true;
+			cerr << "Could not resize " << _pipe_name << " to " << pipe_size << " bytes: " << strerror(errno)
+				 << " (see /proc/sys/fs/pipe-max-size)" << endl;
+		}
+	}
+#endif
 	return fd;
 }
 
+bool FIFORequestChannel::write_fully (struct iovec* iov, int iovcnt) {
+	int first = 0;
+	while (first < iovcnt) {
+		ssize_t n = writev(wfd, iov + first, iovcnt - first);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			return false;
+		}
+		first += skip_iov(iov + first, iovcnt - first, n);
+	}
+	return true;
+}
+
+bool FIFORequestChannel::read_payload (struct iovec* iov, int iovcnt, bool lookahead) {
+	size_t left = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		left += iov[i].iov_len;
+	}
+	// bytes past the payload can only be the next length, never part of another payload
+	iov[iovcnt].iov_base = &next_len;
+	iov[iovcnt].iov_len = lookahead ? sizeof(next_len) : 0;
+
+	int first = 0;
+	while (left > 0) {
+		ssize_t n = readv(rfd, iov + first, iovcnt + 1 - first);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		if ((size_t) n >= left) {
+			next_filled = n - left;
+			return true;
+		}
+		left -= n;
+		first += skip_iov(iov + first, iovcnt - first, n);
+	}
+	return true;
+}
+
 int FIFORequestChannel::cread (void* msgbuf, int msgsize) {
-	return read (rfd, msgbuf, msgsize); 
+	struct iovec iov = {msgbuf, (size_t) msgsize};
+	return creadv(&iov, 1);
 }
 
 int FIFORequestChannel::cwrite (void* msgbuf, int msgsize) {
-	return write (wfd, msgbuf, msgsize);
+	struct iovec iov = {msgbuf, (size_t) msgsize};
+	return cwritev(&iov, 1);
+}
+
+int FIFORequestChannel::creadv (const struct iovec* iov, int iovcnt) {
+	if (iovcnt > MAX_IOV) {
+		return -1;
+	}
+	// the length may already be (partly) there from the lookahead of the previous read
+	while (next_filled < (int) sizeof(next_len)) {
+		ssize_t n = read(rfd, (char*) &next_len + next_filled, sizeof(next_len) - next_filled);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return (n == 0 && next_filled == 0) ? 0 : -1;
+		}
+		next_filled += n;
+	}
+	uint32_t total = next_len;
+	next_filled = 0;
+
+	// the part of the payload that fits into the caller's buffers
+	struct iovec vec[MAX_IOV + 1];
+	int cnt = 0;
+	uint32_t keep = 0;
+	for (int i = 0; i < iovcnt && keep < total; i++) {
+		vec[cnt].iov_base = iov[i].iov_base;
+		vec[cnt].iov_len = min((size_t) (total - keep), iov[i].iov_len);
+		keep += vec[cnt++].iov_len;
+	}
+	if (!read_payload(vec, cnt, keep == total)) {
+		return -1;
+	}
+	// drop whatever does not fit
+	char sink[4096];
+	for (uint32_t left = total - keep; left > 0; ) {
+		vec[0].iov_base = sink;
+		vec[0].iov_len = min(left, (uint32_t) sizeof(sink));
+		left -= vec[0].iov_len;
+		if (!read_payload(vec, 1, left == 0)) {
+			return -1;
+		}
+	}
+	return keep;
 }
 
-string FIFORequestChannel::name () {
-	return my_name;
+int FIFORequestChannel::cwritev (const struct iovec* iov, int iovcnt) {
+	if (iovcnt > MAX_IOV) {
+		return -1;
+	}
+	uint32_t total = 0;
+	struct iovec vec[MAX_IOV + 1];
+	vec[0].iov_base = &total;
+	vec[0].iov_len = sizeof(total);
+	for (int i = 0; i < iovcnt; i++) {
+		vec[i + 1] = iov[i];
+		total += iov[i].iov_len;
+	}
+	return write_fully(vec, iovcnt + 1) ? (int) total : -1;
+}
+
+int FIFORequestChannel::csendfile (int fd, __int64_t offset, int length, char* buf) {
+#ifdef __linux__
+	struct stat st;
+	if (fstat(fd, &st) == 0 && offset + length <= st.st_size) {
+		// the length goes out before any payload, so the file must cover all of it
+		uint32_t total = length;
+		struct iovec hdr = {&total, sizeof(total)};
+		if (!write_fully(&hdr, 1)) {
+			return -1;
+		}
+		loff_t off = offset;
+		int done = 0;
+		while (done < length) {
+			ssize_t n = splice(fd, &off, wfd, NULL, length - done, SPLICE_F_MOVE);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n < 0 && done == 0 && errno == EINVAL) {
+				// a file system without splice support, copy the payload through buf
+				struct iovec payload = {buf, (size_t) length};
+				if (pread(fd, buf, length, offset) != length || !write_fully(&payload, 1)) {
+					return -1;
+				}
+				return length;
+			}
+			if (n <= 0) {
+				return -1;
+			}
+			done += n;
+		}
+		return done;
+	}
+#endif
+	return RequestChannel::csendfile(fd, offset, length, buf);
 }
@@ -1,27 +1,34 @@
 #ifndef _FIFORequestChannel_H_
 #define _FIFORequestChannel_H_
 
-#include "common.h"
+#include "RequestChannel.h"
 
 
-class FIFORequestChannel {
-public:
-	enum Side {SERVER_SIDE, CLIENT_SIDE};
-	enum Mode {READ_MODE, WRITE_MODE};
-	
+class FIFORequestChannel : public RequestChannel {
 private:
 	/*  The current implementation uses named pipes. */
-	std::string my_name;
-	Side my_side;
-	
 	int wfd;
 	int rfd;
 	
 	std::string pipe1, pipe2;
-	int open_pipe (std::string _pipe_name, int mode);
+	int open_pipe (std::string _pipe_name, int mode, const std::function<bool()>& give_up = nullptr);
+	/* give_up is only supported for O_WRONLY, the open that waits for a reader */
+
+	/* A pipe is a byte stream, so every message goes out as a 4-byte length followed by
+	 the payload, both in one writev. The reader collects the payload with readv, which
+	 also picks up the length of the next message if it is already in the pipe; up to
+	 sizeof(next_len) of those bytes wait in next_len for the next read. */
+	uint32_t next_len;
+	int next_filled;
+
+	static int pipe_size;
+
+	bool write_fully (struct iovec* iov, int iovcnt);
+	bool read_payload (struct iovec* iov, int iovcnt, bool lookahead);
+	/* iov must have room for one more entry, the lookahead into next_len */
 	
 public:
-	FIFORequestChannel (const std::string _name, const Side _side);
+	FIFORequestChannel (const std::string _name, const Side _side, const std::function<bool()>& give_up = nullptr);
 	/* Creates a "local copy" of the channel specified by the given name. 
 	 If the channel does not exist, the associated IPC mechanisms are 
 	 created. If the channel exists already, this object is associated with the channel.
@@ -42,21 +49,35 @@ public:
 	 mechanisms associated with the channel. */
 
 
-	int cread (void* msgbuf, int msgsize);
-	/* Blocking read of data from the channel. You must provide the address to properly allocated
+	int cread (void* msgbuf, int msgsize) override;
+	/* Blocking read of one message from the channel. You must provide the address to properly allocated
 	memory buffer and its capacity as arguments. The 2nd argument is needed because the recepient 
-	side may not have as much capacity as the sender wants to send.
+	side may not have as much capacity as the sender wants to send; the rest of a longer message is dropped.
 	
 	In reply, the function puts the read data in the buffer and  
-	returns an integer that tells how much data is read. If the read fails, it returns -1. */
+	returns an integer that tells how much data is read. The whole message is read even if the pipe
+	delivers it in pieces. If the read fails, it returns -1. */
 	
-	int cwrite (void *msgbuf, int msgsize);
-	/* Writes msglen bytes from the msgbuf to the channel. The function returns the actual number of 
-	bytes written and that can be less than msglen (even 0) probably due to buffer limitation (e.g., the recepient
-	cannot accept msglen bytes due to its own buffer capacity. */
-	 
-	std::string name (); 
-	Side side() { return my_side; }  // Getter to use the private field
+	int cwrite (void *msgbuf, int msgsize) override;
+	/* Writes msglen bytes from the msgbuf to the channel as one message. The function returns msglen,
+	or -1 if the other side is gone. */
+
+	int cwritev (const struct iovec* iov, int iovcnt) override;
+	int creadv (const struct iovec* iov, int iovcnt) override;
+
+	int csendfile (int fd, __int64_t offset, int length, char* buf) override;
+	/* On Linux the file pages are spliced into the pipe without passing through buf. */
+
+	int read_fd () override { return rfd; }
+
+	bool can_read () override { return next_filled == sizeof(next_len) && next_len == 0; }
+	/* the lookahead may have taken all of an empty message, which leaves nothing in the
+	 pipe for poll to see */
+
+	static void set_pipe_size (int bytes);
+	/* Asks for pipes of the given capacity (F_SETPIPE_SZ) for every channel opened
+	 afterwards, so a chunk of a large "-m" fits into the pipe at once instead of passing
+	 through it in 64 KiB pieces. Linux only; 0 keeps the system default. */
 };
 
 #endif
@@ -0,0 +1,112 @@
+#include "FileTransfer.h"
+#include "ChunkCodec.h"
+#include "TransferManifest.h"
+
+#include <cstddef>
+
+using namespace std;
+
+
+FileRequestEncoder::FileRequestEncoder (const string& _filename, bool compressed) : header(0, 0), filename(_filename) {
+	header.mtype = compressed ? FILEZ_MSG : FILE_MSG;
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(filemsg);
+	iov[1].iov_base = (void*) filename.c_str();
+	iov[1].iov_len = filename.size() + 1;
+}
+
+FileRequestEncoder::FileRequestEncoder (const string& _filename, MESSAGE_TYPE mtype) : FileRequestEncoder(_filename) {
+	header.mtype = mtype;
+}
+
+int FileRequestEncoder::send (RequestChannel* chan, __int64_t offset, int length) {
+	header.offset = offset;
+	header.length = length;
+	return chan->cwritev(iov, 2);
+}
+
+bool decode_file_request (const char* request, int len, FileRequestView& out) {
+	if (len <= (int) sizeof(filemsg)) {
+		return false;
+	}
+	const char* name = request + sizeof(filemsg);
+	const char* end = (const char*) memchr(name, 0, len - sizeof(filemsg));
+	if (!end) {
+		return false;
+	}
+	memcpy(&out.offset, request + offsetof(filemsg, offset), sizeof(out.offset));
+	memcpy(&out.length, request + offsetof(filemsg, length), sizeof(out.length));
+	out.filename = string_view(name, end - name);
+	return true;
+}
+
+__int64_t request_file_size (RequestChannel* chan, FileRequestEncoder& enc) {
+	enc.send(chan, 0, 0);  // offset 0 and length 0 ask for the size
+	__int64_t filesize = 0;
+	if (chan->cread(&filesize, sizeof(__int64_t)) != sizeof(__int64_t)) {
+		return -1;
+	}
+	return filesize;
+}
+
+int receive_chunk (RequestChannel* chan, bool compressed, char* buf, int len, char* packed) {
+	/* one cread per reply: every transport hands over one message per read, so reading on
+	after a short chunk would take the start of the next reply as the rest of this one */
+	if (!compressed) {
+		return chan->cread(buf, len);
+	}
+	// the reply is one message: its length and then the packed chunk
+	int length = -1;
+	struct iovec iov[2] = {{&length, sizeof(int)}, {packed, (size_t) pack_bound(len)}};
+	int n = chan->creadv(iov, 2);
+	if (n <= (int) sizeof(int) || length != len) {
+		return n <= 0 ? n : -1;
+	}
+	return unpack_chunk(packed, n - sizeof(int), buf, len);
+}
+
+int unpack_reply (const char* reply, int n, char* buf, int len) {
+	int length = -1;
+	if (n <= (int) sizeof(int)) {
+		return -1;
+	}
+	memcpy(&length, reply, sizeof(int));
+	if (length != len) {
+		return -1;
+	}
+	return unpack_chunk(reply + sizeof(int), n - sizeof(int), buf, len);
+}
+
+int request_checksums (RequestChannel* chan, FileRequestEncoder& enc, __int64_t offset, int m, uint64_t* out) {
+	int capacity = filesum_capacity(m);
+	if (enc.send(chan, offset, m) < 0) {
+		return -1;
+	}
+	int n = 0;
+	struct iovec iov[2] = {{&n, sizeof(int)}, {out, capacity * sizeof(uint64_t)}};
+	int got = chan->creadv(iov, 2);
+	if (got < (int) sizeof(int) || n < 0 || n > capacity || got != (int) (sizeof(int) + n * sizeof(uint64_t))) {
+		return -1;
+	}
+	return n;
+}
+
+bool transfer_chunks (RequestChannel* chan, FileRequestEncoder& enc, __int64_t offset, __int64_t end, int m, char* buf, int outfd, char* packed, TransferManifest* manifest) {
+	while (offset < end) {
+		int len = (int) min((__int64_t) m, end - offset);
+		if (enc.send(chan, offset, len) < 0 || receive_chunk(chan, enc.compressed(), buf, len, packed) != len) {
+			return false;
+		}
+		// a chunk that does not match is left out of the manifest, so a resume fetches it again
+		if (!manifest || manifest->verify(offset, buf, len)) {
+			if (pwrite(outfd, buf, len, offset) != len) {
+				return false;
+			}
+			if (manifest) {
+				manifest->complete(offset, len);
+			}
+		}
+		offset += len;
+	}
+	return true;
+}
@@ -0,0 +1,70 @@
+#ifndef _FileTransfer_H_
+#define _FileTransfer_H_
+
+#include "RequestChannel.h"
+
+class TransferManifest;
+
+#include <string_view>
+#include <vector>
+
+
+class FileRequestEncoder {
+private:
+	/* A FILE_MSG request is a filemsg followed by the null-terminated file name. The name
+	 is stored once per file and sent behind the header with cwritev, so every chunk only
+	 overwrites offset and length in the header and never copies or allocates the name. */
+	filemsg header;
+	std::string filename;
+	struct iovec iov[2];
+
+public:
+	FileRequestEncoder (const std::string& _filename, bool compressed = false);
+	/* compressed sends FILEZ_MSG requests, whose replies are read with receive_chunk */
+	FileRequestEncoder (const std::string& _filename, MESSAGE_TYPE mtype);
+	/* any request with the FILE_MSG layout, such as FILESUM_MSG */
+	FileRequestEncoder (const FileRequestEncoder&) = delete;  // iov points into this object
+
+	bool compressed () const { return header.mtype == FILEZ_MSG; }
+
+	int send (RequestChannel* chan, __int64_t offset, int length);
+	/* sends the request for length bytes at offset, returns what cwritev returns */
+};
+
+
+struct FileRequestView {
+	__int64_t offset;
+	int length;
+	std::string_view filename;  // points into the request buffer, without the terminator
+};
+
+bool decode_file_request (const char* request, int len, FileRequestView& out);
+/* Server side of the encoder: reads a FILE_MSG of len bytes without copying the file name.
+ Returns false if the name is not null-terminated within len. */
+
+
+__int64_t request_file_size (RequestChannel* chan, FileRequestEncoder& enc);
+
+int receive_chunk (RequestChannel* chan, bool compressed, char* buf, int len, char* packed);
+/* Reads the reply to a request for a chunk of len bytes into buf. A FILEZ_MSG reply is
+ read into packed, which must hold pack_bound(len) bytes, and unpacked from there. Returns
+ len, or something else if the channel failed, the reply is damaged or it is shorter than
+ len (the file shrank on the server), which callers treat as an error. */
+
+int unpack_reply (const char* reply, int n, char* buf, int len);
+/* Unpacks a FILEZ_MSG reply of n bytes, its length and the packed chunk, into buf of len
+ bytes. Returns len, or -1 if the reply does not hold a chunk of len bytes. */
+
+int request_checksums (RequestChannel* chan, FileRequestEncoder& enc, __int64_t offset, int m, uint64_t* out);
+/* Asks for the checksums of the chunks of m bytes from offset on with a FILESUM_MSG encoder.
+ out must hold filesum_capacity(m) of them. Returns how many arrived, or -1. */
+
+bool transfer_chunks (RequestChannel* chan, FileRequestEncoder& enc, __int64_t offset, __int64_t end, int m, char* buf, int outfd, char* packed = NULL, TransferManifest* manifest = NULL);
+/* Requests [offset, end) of the file in chunks of at most m bytes, one at a time, and
+ writes each reply to its offset in outfd. buf must hold m bytes, and packed
+ pack_bound(m) bytes if the encoder is compressed. With a manifest, offset is a multiple
+ of m and only chunks that match their checksum are written and recorded as complete.
+ The loop makes no heap allocations. Returns false if the channel or the output file
+ fails. */
+
+#endif
@@ -0,0 +1,37 @@
+#include "Histogram.h"
+
+#include <cmath>
+
+using namespace std;
+
+
+Histogram::Histogram (int _nbins, double _start, double _end) : hist(_nbins, 0), nbins(_nbins), start(_start), end(_end) {
+}
+
+Histogram::~Histogram () {
+}
+
+void Histogram::update (double value) {
+	int bin = (int) floor((value - start) / (end - start) * nbins);
+	if (bin < 0) {
+		bin = 0;
+	}
+	else if (bin >= nbins) {
+		bin = nbins - 1;
+	}
+	lock_guard<mutex> lock(mtx);
+	hist[bin]++;
+}
+
+vector<int> Histogram::get_hist () {
+	lock_guard<mutex> lock(mtx);
+	return hist;
+}
+
+int Histogram::size () {
+	return nbins;
+}
+
+vector<double> Histogram::get_range () {
+	return {start, end};
+}
@@ -0,0 +1,27 @@
+#ifndef _Histogram_H_
+#define _Histogram_H_
+
+#include <mutex>
+#include <vector>
+
+
+class Histogram {
+private:
+	/* nbins equal-width bins over [start, end); values outside of the range are counted
+	 in the first or the last bin */
+	std::vector<int> hist;
+	int nbins;
+	double start, end;
+	std::mutex mtx;  // several histogram threads update the same patient
+
+public:
+	Histogram (int _nbins, double _start, double _end);
+	~Histogram ();
+
+	void update (double value);
+	std::vector<int> get_hist ();
+	int size ();
+	std::vector<double> get_range ();
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "HistogramCollection.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+
+HistogramCollection::HistogramCollection () {
+}
+
+HistogramCollection::~HistogramCollection () {
+	for (Histogram* h : hists) {
+		delete h;
+	}
+}
+
+void HistogramCollection::add (Histogram* hist) {
+	hists.push_back(hist);
+}
+
+void HistogramCollection::update (int person, double value) {
+	hists[person-1]->update(value);
+}
+
+void HistogramCollection::print () {
+	if (hists.empty()) {
+		return;
+	}
+	int nbins = hists[0]->size();
+	vector<double> range = hists[0]->get_range();
+	double width = (range[1] - range[0]) / nbins;
+
+	cout << setw(10) << "patient";
+	for (int b = 0; b < nbins; b++) {
+		cout << setw(8) << fixed << setprecision(2) << range[0] + b * width;
+	}
+	cout << setw(10) << "total" << endl;
+
+	for (size_t p = 0; p < hists.size(); p++) {
+		vector<int> counts = hists[p]->get_hist();
+		int total = 0;
+		cout << setw(10) << p + 1;
+		for (int c : counts) {
+			cout << setw(8) << c;
+			total += c;
+		}
+		cout << setw(10) << total << endl;
+	}
+	cout.unsetf(ios::fixed);
+	cout << setprecision(6);
+}
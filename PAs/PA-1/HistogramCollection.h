@@ -0,0 +1,23 @@
+#ifndef _HistogramCollection_H_
+#define _HistogramCollection_H_
+
+#include "Histogram.h"
+
+
+class HistogramCollection {
+private:
+	std::vector<Histogram*> hists;  // one per patient, owned by the collection
+
+public:
+	HistogramCollection ();
+	~HistogramCollection ();
+
+	void add (Histogram* hist);
+	void update (int person, double value);
+	/* person is 1-based, like in datamsg */
+
+	void print ();
+	/* prints one row of bin counts per patient followed by the row total */
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "MQRequestChannel.h"
+
+#include <sys/file.h>
+
+using namespace std;
+
+/*--------------------------------------------------------------------------*/
+/*		CONSTRUCTOR/DESTRUCTOR FOR CLASS	M Q R e q u e s t C h a n n e l	*/
+/*--------------------------------------------------------------------------*/
+
+MQRequestChannel::MQRequestChannel (const string _name, const Side _side) : RequestChannel(_name, _side) {
+	mq1 = "/mq_" + my_name + "1";
+	mq2 = "/mq_" + my_name + "2";
+
+	if (_side == SERVER_SIDE) {
+		wq = open_queue(mq1, O_WRONLY);
+		rq = open_queue(mq2, O_RDONLY);
+	}
+	else {
+		rq = open_queue(mq1, O_RDONLY);
+		wq = open_queue(mq2, O_WRONLY);
+	}
+	frame = new char[FRAME_SIZE];
+}
+
+MQRequestChannel::~MQRequestChannel () {
+	delete[] frame;
+	mq_close(wq);
+	mq_close(rq);
+
+	mq_unlink(mq1.c_str());
+	mq_unlink(mq2.c_str());
+}
+
+/*--------------------------------------------------------------------------*/
+/*		MEMBER FUNCTIONS FOR CLASS	M Q R e q u e s t C h a n n e l			*/
+/*--------------------------------------------------------------------------*/
+
+mqd_t MQRequestChannel::open_queue (string _queue_name, int mode) {
+	mqd_t q;
+	if (my_side == SERVER_SIDE) {
+		struct mq_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.mq_maxmsg = MAX_FRAMES;
+		attr.mq_msgsize = FRAME_SIZE;
+		mq_unlink(_queue_name.c_str());  // left behind by a server that crashed
+		q = mq_open(_queue_name.c_str(), mode | O_CREAT | O_EXCL, 0600, &attr);
+		// held until the server closes the queue or dies, and tells clients it is alive
+		if (q != (mqd_t) -1 && flock(q, LOCK_SH) < 0) {
+			EXITONERROR(_queue_name);
+		}
+	}
+	else {
+		while (true) {
+			q = mq_open(_queue_name.c_str(), mode);
+			if (q == (mqd_t) -1 && errno != ENOENT) {
+				break;
+			}
+			// a queue nobody holds the lock of is stale, wait for the server to replace it
+			if (q != (mqd_t) -1 && flock(q, LOCK_EX | LOCK_NB) < 0 && errno == EWOULDBLOCK) {
+				break;
+			}
+			if (q != (mqd_t) -1) {
+				mq_close(q);
+			}
+			usleep(100);
+		}
+	}
+	if (q == (mqd_t) -1) {
+		EXITONERROR(_queue_name);
+	}
+	return q;
+}
+
+int MQRequestChannel::cread (void* msgbuf, int msgsize) {
+	char* buf = (char*) msgbuf;
+	uint32_t total = 0;
+	int done = 0;
+	bool first = true;
+	while (first || (uint32_t) done < total) {
+		ssize_t n = mq_receive(rq, frame, FRAME_SIZE, NULL);
+		if (n < 0) {
+			return -1;
+		}
+		char* payload = frame;
+		if (first) {
+			memcpy(&total, frame, sizeof(total));
+			payload += sizeof(total);
+			n -= sizeof(total);
+			first = false;
+		}
+		// bytes beyond the caller's buffer are dropped, as with a short read of a FIFO
+		int keep = min((int) n, max(msgsize - done, 0));
+		memcpy(buf + done, payload, keep);
+		done += n;
+	}
+	return min((int) total, msgsize);
+}
+
+int MQRequestChannel::cwrite (void* msgbuf, int msgsize) {
+	const char* buf = (const char*) msgbuf;
+	uint32_t total = msgsize;
+	memcpy(frame, &total, sizeof(total));
+	int first = min(msgsize, (int) (FRAME_SIZE - sizeof(total)));
+	memcpy(frame + sizeof(total), buf, first);
+	if (mq_send(wq, frame, sizeof(total) + first, 0) < 0) {
+		return -1;
+	}
+	for (int done = first; done < msgsize; ) {
+		int n = min(msgsize - done, (int) FRAME_SIZE);
+		if (mq_send(wq, buf + done, n, 0) < 0) {
+			return -1;
+		}
+		done += n;
+	}
+	return msgsize;
+}
@@ -0,0 +1,39 @@
+#ifndef _MQRequestChannel_H_
+#define _MQRequestChannel_H_
+
+#include "RequestChannel.h"
+
+#include <mqueue.h>
+#include <stdint.h>
+
+
+class MQRequestChannel : public RequestChannel {
+private:
+	/* One POSIX message queue per direction. The kernel caps the size of a single message
+	 (fs.mqueue.msgsize_max), so a request or reply is sent as a series of frames where the
+	 first frame starts with the total length of the message. */
+	std::string mq1, mq2;
+	mqd_t wq;
+	mqd_t rq;
+	char* frame;  // receive buffer of one frame, allocated once per channel
+
+	mqd_t open_queue (std::string _queue_name, int mode);
+
+public:
+	static const long MAX_FRAMES = 10;   // default fs.mqueue.msg_max
+	static const long FRAME_SIZE = 4096; // keeps 2 queues per channel well inside RLIMIT_MSGQUEUE
+
+	MQRequestChannel (const std::string _name, const Side _side);
+	/* The server side creates both queues (removing stale ones first) and holds a shared
+	 flock on them while it lives; the client side waits until both exist and are locked, so
+	 it never opens a queue left behind by a server that crashed. */
+	~MQRequestChannel ();
+
+	int cread (void* msgbuf, int msgsize) override;
+	int cwrite (void* msgbuf, int msgsize) override;
+
+	int read_fd () override { return rq; }  // a message queue descriptor is a file descriptor on Linux
+	int max_queued () override { return MAX_FRAMES; }  // a message of up to FRAME_SIZE is one frame
+};
+
+#endif
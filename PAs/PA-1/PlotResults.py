@@ -1,11 +1,54 @@
+import sys
 import matplotlib.pyplot as plt
 import numpy as np
-data = np.loadtxt('benchmark_results.txt')
-plt.figure(figsize=(10, 6))
-plt.scatter(data[:,0], data[:,1])
-plt.xlabel('File Size (bytes)')
-plt.ylabel('Execution Time (seconds)')
-plt.title('Client Performance: File Size vs Execution Time')
-plt.grid(True)
-plt.savefig('benchmark_plot.png')
-plt.show()
\ No newline at end of file
+
+if len(sys.argv) < 2:
+    # benchmark_tests.sh results: file size vs client execution time
+    data = np.loadtxt('benchmark_results.txt')
+    plt.figure(figsize=(10, 6))
+    plt.scatter(data[:,0], data[:,1])
+    plt.xlabel('File Size (bytes)')
+    plt.ylabel('Execution Time (seconds)')
+    plt.title('Client Performance: File Size vs Execution Time')
+    plt.grid(True)
+    plt.savefig('benchmark_plot.png')
+    plt.show()
+    sys.exit(0)
+
+# ./bench results (CSV): throughput and latency per transport, the median over repetitions
+data = np.genfromtxt(sys.argv[1], delimiter=',', names=True, dtype=None, encoding=None)
+fig, (tput, lat) = plt.subplots(1, 2, figsize=(14, 6))
+# results of several server thread placements (./bench -A) get a line each
+pinnings = sorted(set(data['pinning'])) if 'pinning' in data.dtype.names else [None]
+for pinning in pinnings:
+    runs = data if pinning is None else data[data['pinning'] == pinning]
+    suffix = '' if len(pinnings) < 2 else ', -A %s' % pinning
+    for transport in sorted(set(runs['transport'])):
+        for channels in sorted(set(runs['channels'])):
+            rows = runs[(runs['transport'] == transport) & (runs['workload'] == 'file') & (runs['channels'] == channels)]
+            if len(rows) == 0:
+                continue
+            sizes = sorted(set(rows['m']))
+            label = '-i %s, %d channel(s)%s' % (transport, channels, suffix)
+            tput.plot(sizes, [np.median(rows[rows['m'] == m]['bytes_per_s']) / 2**20 for m in sizes], marker='o', label=label)
+        rows = runs[(runs['transport'] == transport) & (runs['workload'] == 'data')]
+        if len(rows) == 0:
+            continue
+        counts = sorted(set(rows['channels']))
+        for column, style in (('p50_us', '-'), ('p99_us', '--')):
+            lat.plot(counts, [np.median(rows[rows['channels'] == c][column]) for c in counts], style, marker='o',
+                     label='-i %s %s%s' % (transport, column[:-3], suffix))
+tput.set_xscale('log', base=2)
+tput.set_xlabel('Buffer Capacity m (bytes)')
+tput.set_ylabel('File Transfer Throughput (MiB/s)')
+tput.set_title('Throughput vs Buffer Capacity')
+tput.grid(True)
+tput.legend(fontsize='small')
+lat.set_xlabel('Channels')
+lat.set_ylabel('Data Request Latency (us)')
+lat.set_title('Data Request Latency Percentiles')
+lat.grid(True)
+lat.legend(fontsize='small')
+plt.tight_layout()
+plt.savefig('bench_plot.png')
+plt.show()
@@ -0,0 +1,60 @@
+#include "Rendezvous.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+
+static struct sockaddr_un rendezvous_addr (const string& path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+int rendezvous_listen (const string& path) {
+	struct sockaddr_un addr = rendezvous_addr(path);
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path.c_str());
+	if (lfd < 0 || bind(lfd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(lfd, 64) < 0) {
+		EXITONERROR(path);
+	}
+	return lfd;
+}
+
+bool rendezvous_reply (int conn, char ipc_type, const string& name, int capacity) {
+	string line = name.empty() ? "\n" : string(1, ipc_type) + " " + name + " " + to_string(capacity) + "\n";
+	return write(conn, line.c_str(), line.size()) == (ssize_t) line.size();
+}
+
+bool rendezvous_connect (const string& path, char& ipc_type, string& name, int& capacity) {
+	struct sockaddr_un addr = rendezvous_addr(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		perror(path.c_str());
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	// the server closes the connection after its line
+	string line;
+	char buf[128];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		line.append(buf, n);
+	}
+	close(fd);
+
+	char type = 0;
+	char namebuf[64] = {0};
+	if (sscanf(line.c_str(), "%c %63s %d", &type, namebuf, &capacity) != 3) {
+		cerr << "The server at " << path << " refused the connection" << endl;
+		return false;
+	}
+	ipc_type = type;
+	name = namebuf;
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef _Rendezvous_H_
+#define _Rendezvous_H_
+
+#include "common.h"
+
+/* A server in daemon mode (-d) listens on a UNIX socket at a well-known path, by default
+ RENDEZVOUS_PATH in its working directory. A client started with --connect connects to it
+ and gets one line back, "<transport> <control channel name> <buffer capacity>", after
+ which the socket is closed and everything else goes over the named control channel of
+ that transport, the same way as with a server of its own. An empty line means the
+ server has no channel left for another client. */
+#define RENDEZVOUS_PATH "pa1_server.sock"
+
+
+int rendezvous_listen (const std::string& path);
+/* binds and listens on path, replacing a stale socket file; exits on failure */
+
+bool rendezvous_reply (int conn, char ipc_type, const std::string& name, int capacity);
+/* answers the client on conn, an empty name refuses it */
+
+bool rendezvous_connect (const std::string& path, char& ipc_type, std::string& name, int& capacity);
+/* asks the server at path for a control channel; false if there is no server or it
+ refused the client */
+
+#endif
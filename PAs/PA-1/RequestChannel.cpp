@@ -0,0 +1,137 @@
+#include "RequestChannel.h"
+#include "FIFORequestChannel.h"
+#include "SHMRequestChannel.h"
+#include "SocketRequestChannel.h"
+#ifdef __linux__
+#include "MQRequestChannel.h"
+#endif
+
+using namespace std;
+
+
+int RequestChannel::csendfile (int fd, __int64_t offset, int length, char* buf) {
+	int nbytes = pread(fd, buf, length, offset);
+	if (nbytes < 0) {
+		return -1;
+	}
+	return cwrite(buf, nbytes);
+}
+
+int RequestChannel::cread_full (void* buf, int len) {
+	int done = 0;
+	while (done < len) {
+		int n = cread((char*) buf + done, len - done);
+		if (n <= 0) {
+			return n;
+		}
+		done += n;
+	}
+	return done;
+}
+
+int RequestChannel::cwrite_full (void* buf, int len) {
+	int done = 0;
+	while (done < len) {
+		int n = cwrite((char*) buf + done, len - done);
+		if (n <= 0) {
+			return -1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+// scratch for the gathering/scattering defaults, grown to the largest message and then reused
+static thread_local vector<char> iov_scratch;
+
+static size_t iov_total (const struct iovec* iov, int iovcnt) {
+	size_t total = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
+int RequestChannel::cwritev (const struct iovec* iov, int iovcnt) {
+	if (iovcnt == 1) {
+		return cwrite(iov[0].iov_base, iov[0].iov_len);
+	}
+	size_t total = iov_total(iov, iovcnt);
+	if (iov_scratch.size() < total) {
+		iov_scratch.resize(total);
+	}
+	size_t done = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		memcpy(iov_scratch.data() + done, iov[i].iov_base, iov[i].iov_len);
+		done += iov[i].iov_len;
+	}
+	return cwrite(iov_scratch.data(), total);
+}
+
+int RequestChannel::creadv (const struct iovec* iov, int iovcnt) {
+	if (iovcnt == 1) {
+		return cread(iov[0].iov_base, iov[0].iov_len);
+	}
+	size_t total = iov_total(iov, iovcnt);
+	if (iov_scratch.size() < total) {
+		iov_scratch.resize(total);
+	}
+	int n = cread(iov_scratch.data(), total);
+	size_t done = 0;
+	for (int i = 0; i < iovcnt && (int) done < n; i++) {
+		size_t len = min(iov[i].iov_len, n - done);
+		memcpy(iov[i].iov_base, iov_scratch.data() + done, len);
+		done += len;
+	}
+	return n;
+}
+
+int skip_iov (struct iovec* iov, int iovcnt, size_t n) {
+	int i = 0;
+	while (i < iovcnt && n >= iov[i].iov_len) {
+		n -= iov[i].iov_len;
+		i++;
+	}
+	if (i < iovcnt) {
+		iov[i].iov_base = (char*) iov[i].iov_base + n;
+		iov[i].iov_len -= n;
+	}
+	return i;
+}
+
+bool valid_ipc_type (char ipc_type) {
+#ifdef __linux__
+	if (ipc_type == 'q') {
+		return true;
+	}
+#endif
+	return ipc_type == 'f' || ipc_type == 's' || ipc_type == 'u';
+}
+
+RequestChannel* create_channel (char ipc_type, const string _name, const RequestChannel::Side _side, const function<bool()>& give_up) {
+	RequestChannel* chan = NULL;
+	switch (ipc_type) {
+		case 'f':
+			chan = new FIFORequestChannel(_name, _side, give_up);
+			break;
+		case 's':
+			chan = new SHMRequestChannel(_name, _side);  // the server side never waits for the client
+			break;
+		case 'u':
+			chan = new SocketRequestChannel(_name, _side, give_up);
+			break;
+#ifdef __linux__
+		case 'q':
+			chan = new MQRequestChannel(_name, _side);
+			break;
+#endif
+		default:
+			cerr << "Unknown IPC type: " << ipc_type << endl;
+			exit(-1);
+	}
+	if (!chan->is_open()) {
+		delete chan;
+		return NULL;
+	}
+	return chan;
+}
@@ -0,0 +1,100 @@
+#ifndef _RequestChannel_H_
+#define _RequestChannel_H_
+
+#include "common.h"
+
+#include <functional>
+#include <sys/uio.h>
+
+
+class RequestChannel {
+public:
+	enum Side {SERVER_SIDE, CLIENT_SIDE};
+	enum Mode {READ_MODE, WRITE_MODE};
+
+protected:
+	std::string my_name;
+	Side my_side;
+	bool opened;  // cleared by a server side that gave up waiting for its client
+
+public:
+	RequestChannel (const std::string _name, const Side _side) : my_name(_name), my_side(_side), opened(true) {}
+	/* Every transport (named pipes, shared memory, ...) is a RequestChannel, so the client
+	 and the server only depend on this interface and pick the transport at runtime. */
+
+	virtual ~RequestChannel () {}
+
+	virtual int cread (void* msgbuf, int msgsize) = 0;
+	/* Blocking read of one reply/request into msgbuf of capacity msgsize. Returns the number
+	 of bytes read, 0 if the other side closed the channel and -1 on error. */
+
+	virtual int cwrite (void* msgbuf, int msgsize) = 0;
+	/* Writes msgsize bytes from msgbuf to the channel. Returns the number of bytes written
+	 or -1 on error. */
+
+	int cread_full (void* buf, int len);
+	/* Reads exactly len bytes, over as many messages as that takes. Only for a payload the
+	 other side deliberately splits across messages, such as the STATS_MSG text: a reply is
+	 one message, and reading on after a short one would swallow the next reply, so replies
+	 are read with a single cread/creadv and their length checked. Returns len, 0 if the
+	 other side closed the channel first and -1 on error. */
+
+	int cwrite_full (void* buf, int len);
+	/* Writes exactly len bytes, calling cwrite again for whatever it did not take. Returns
+	 len or -1 on error. */
+
+	static const int MAX_IOV = 8;
+
+	virtual int cwritev (const struct iovec* iov, int iovcnt);
+	/* Writes the iovcnt buffers of iov (at most MAX_IOV) as a single message, so a header
+	 and its payload need not be copied next to each other first. The default gathers them
+	 into a per-thread buffer and calls cwrite; stream transports hand them to the kernel
+	 as they are. Returns the number of bytes written or -1 on error. */
+
+	virtual int creadv (const struct iovec* iov, int iovcnt);
+	/* Reads one message and scatters it over the buffers of iov in order. What does not fit
+	 is dropped, like with cread. Returns the number of bytes stored, 0 if the other side
+	 closed the channel and -1 on error. */
+
+	virtual int csendfile (int fd, __int64_t offset, int length, char* buf);
+	/* Writes length bytes of the open file fd, starting at offset, as one message. The
+	 default reads them into buf (at least length bytes) with pread and calls cwrite;
+	 transports that can move file pages into the kernel object directly override it. Returns
+	 the number of bytes sent or -1 on error. */
+
+	virtual int read_fd () { return -1; }
+	/* A descriptor that becomes readable when a message arrives, for use with poll/epoll,
+	 or -1 if the transport has none (shared memory). */
+
+	virtual int max_queued () { return 0; }
+	/* The most messages that fit into one direction of the channel before a writer blocks,
+	 or 0 if only their size in bytes limits it (pipes, sockets, shared memory rings). */
+
+	virtual bool can_read () { return false; }
+	/* True if cread would return at once because a message (or the other side's close) is
+	 already in memory the channel reads from, where read_fd() cannot show it. Shared
+	 memory has no descriptor, so this is the only way to watch it without blocking. */
+
+	bool is_open () const { return opened; }
+
+	std::string name () { return my_name; }
+	Side side () { return my_side; }
+};
+
+
+RequestChannel* create_channel (char ipc_type, const std::string _name, const RequestChannel::Side _side, const std::function<bool()>& give_up = nullptr);
+/* Creates the channel for the transport selected with "-i" (see IPC_TYPE_USAGE). Exits
+ the program on an unknown transport. The server side of pipes and sockets waits in the
+ open until the client shows up; with give_up it asks every few milliseconds whether to
+ keep waiting, and once give_up returns true the channel is dropped and NULL returned. */
+
+int skip_iov (struct iovec* iov, int iovcnt, size_t n);
+/* Drops the first n bytes of iov after a partial readv/writev and returns the index of the
+ first buffer that still has bytes left (iovcnt once all of them are done). */
+
+bool valid_ipc_type (char ipc_type);
+/* POSIX message queues only exist on Linux, the other transports are available everywhere. */
+
+#define IPC_TYPE_USAGE "f (FIFO), q (POSIX message queue), s (shared memory) or u (UNIX socket)"
+
+#endif
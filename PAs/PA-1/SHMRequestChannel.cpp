@@ -0,0 +1,210 @@
+#include "SHMRequestChannel.h"
+
+#include <new>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+
+static const size_t SEGMENT_SIZE = sizeof(SHMRing) + SHMQueue::CAPACITY;
+
+/* spin first, since the other side usually answers within microseconds, then back off
+ so that an idle channel does not burn a core */
+static void backoff (int& spins) {
+	if (spins < 1000) {
+		spins++;
+	}
+	else if (spins < 2000) {
+		spins++;
+		sched_yield();
+	}
+	else {
+		usleep(50);
+	}
+}
+
+/*--------------------------------------------------------------------------*/
+/*		CONSTRUCTOR/DESTRUCTOR FOR CLASS	S H M Q u e u e					*/
+/*--------------------------------------------------------------------------*/
+
+SHMQueue::SHMQueue (const string _name, bool _owner) : my_name(_name), owner(_owner) {
+	if (owner) {
+		shm_unlink(my_name.c_str());  // left behind by a server that crashed
+		fd = shm_open(my_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0 || ftruncate(fd, SEGMENT_SIZE) < 0) {
+			EXITONERROR(my_name);
+		}
+		void* addr = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			EXITONERROR(my_name);
+		}
+		ring = new (addr) SHMRing();
+		ring->owner = getpid();
+	}
+	else {
+		int spins = 0;
+		while (true) {
+			fd = shm_open(my_name.c_str(), O_RDWR, 0600);
+			struct stat st;
+			if (fd >= 0 && fstat(fd, &st) == 0 && (size_t) st.st_size == SEGMENT_SIZE) {
+				void* addr = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if (addr == MAP_FAILED) {
+					EXITONERROR(my_name);
+				}
+				ring = (SHMRing*) addr;
+				if (ring->owner != 0 && kill(ring->owner, 0) == 0) {
+					break;
+				}
+				munmap(addr, SEGMENT_SIZE);  // stale segment, wait for the server to replace it
+			}
+			if (fd >= 0) {
+				close(fd);
+			}
+			backoff(spins);
+		}
+	}
+	data = (char*) ring + sizeof(SHMRing);
+}
+
+SHMQueue::~SHMQueue () {
+	close_queue();
+	munmap(ring, SEGMENT_SIZE);
+	close(fd);
+	/* the client side only ever maps a segment the server already has mapped, so either
+	 side can remove the name, like both ends of a FIFO channel remove the pipe files */
+	shm_unlink(my_name.c_str());
+}
+
+/*--------------------------------------------------------------------------*/
+/*			MEMBER FUNCTIONS FOR CLASS	S H M Q u e u e						*/
+/*--------------------------------------------------------------------------*/
+
+bool SHMQueue::wait_for (bool writing, uint64_t needed) {
+	int spins = 0;
+	while (true) {
+		uint64_t head = ring->head.load(memory_order_acquire);
+		uint64_t tail = ring->tail.load(memory_order_acquire);
+		uint64_t avail = writing ? CAPACITY - (head - tail) : head - tail;
+		if (avail >= needed) {
+			return true;
+		}
+		if (ring->closed.load(memory_order_acquire)) {
+			return false;
+		}
+		backoff(spins);
+	}
+}
+
+void SHMQueue::copy_in (const char* src, uint64_t len) {
+	uint64_t head = ring->head.load(memory_order_relaxed);
+	uint64_t pos = head & (CAPACITY - 1);
+	uint64_t first = min(len, CAPACITY - pos);
+	memcpy(data + pos, src, first);
+	memcpy(data, src + first, len - first);
+	ring->head.store(head + len, memory_order_release);
+}
+
+void SHMQueue::copy_out (char* dst, uint64_t len) {
+	uint64_t tail = ring->tail.load(memory_order_relaxed);
+	if (dst) {
+		uint64_t pos = tail & (CAPACITY - 1);
+		uint64_t first = min(len, CAPACITY - pos);
+		memcpy(dst, data + pos, first);
+		memcpy(dst + first, data, len - first);
+	}
+	ring->tail.store(tail + len, memory_order_release);
+}
+
+int SHMQueue::push (const char* msg, int len) {
+	uint32_t hdr = len;
+	if (!wait_for(true, sizeof(hdr))) {
+		return -1;
+	}
+	copy_in((const char*) &hdr, sizeof(hdr));
+
+	uint64_t done = 0;
+	while (done < hdr) {
+		if (!wait_for(true, 1)) {
+			return -1;
+		}
+		uint64_t head = ring->head.load(memory_order_relaxed);
+		uint64_t space = CAPACITY - (head - ring->tail.load(memory_order_acquire));
+		uint64_t n = min(space, (uint64_t) hdr - done);
+		copy_in(msg + done, n);
+		done += n;
+	}
+	return len;
+}
+
+int SHMQueue::pop (char* buf, int bufsize) {
+	uint32_t hdr = 0;
+	if (!wait_for(false, sizeof(hdr))) {
+		return 0;
+	}
+	copy_out((char*) &hdr, sizeof(hdr));
+
+	uint64_t done = 0;
+	while (done < hdr) {
+		if (!wait_for(false, 1)) {
+			return 0;
+		}
+		uint64_t avail = ring->head.load(memory_order_acquire) - ring->tail.load(memory_order_relaxed);
+		uint64_t n = min(avail, (uint64_t) hdr - done);
+		// bytes beyond the caller's buffer are consumed but dropped
+		uint64_t keep = done < (uint64_t) bufsize ? min(n, (uint64_t) bufsize - done) : 0;
+		if (keep) {
+			copy_out(buf + done, keep);
+		}
+		if (n > keep) {
+			copy_out(NULL, n - keep);
+		}
+		done += n;
+	}
+	return min((int) hdr, bufsize);
+}
+
+bool SHMQueue::readable () const {
+	return ring->head.load(memory_order_acquire) != ring->tail.load(memory_order_relaxed) || ring->closed.load(memory_order_acquire);
+}
+
+void SHMQueue::close_queue () {
+	ring->closed.store(1, memory_order_release);
+}
+
+/*--------------------------------------------------------------------------*/
+/*		CONSTRUCTOR/DESTRUCTOR FOR CLASS	S H M R e q u e s t C h a n n e l	*/
+/*--------------------------------------------------------------------------*/
+
+SHMRequestChannel::SHMRequestChannel (const string _name, const Side _side) : RequestChannel(_name, _side) {
+	string q1 = "/shm_" + my_name + "1";
+	string q2 = "/shm_" + my_name + "2";
+
+	bool server = (_side == SERVER_SIDE);
+	if (server) {
+		wq = new SHMQueue(q1, true);
+		rq = new SHMQueue(q2, true);
+	}
+	else {
+		rq = new SHMQueue(q1, false);
+		wq = new SHMQueue(q2, false);
+	}
+}
+
+SHMRequestChannel::~SHMRequestChannel () {
+	delete wq;
+	delete rq;
+}
+
+/*--------------------------------------------------------------------------*/
+/*		MEMBER FUNCTIONS FOR CLASS	S H M R e q u e s t C h a n n e l		*/
+/*--------------------------------------------------------------------------*/
+
+int SHMRequestChannel::cread (void* msgbuf, int msgsize) {
+	return rq->pop((char*) msgbuf, msgsize);
+}
+
+int SHMRequestChannel::cwrite (void* msgbuf, int msgsize) {
+	return wq->push((const char*) msgbuf, msgsize);
+}
@@ -0,0 +1,73 @@
+#ifndef _SHMRequestChannel_H_
+#define _SHMRequestChannel_H_
+
+#include "RequestChannel.h"
+
+#include <atomic>
+#include <stdint.h>
+
+
+/* Header of a single-producer/single-consumer byte ring that lives at the start of a
+ POSIX shared memory segment; the ring's data follows it in the same segment. head and
+ tail are running byte counts, so (head - tail) is the number of unread bytes. */
+struct SHMRing {
+	alignas(64) std::atomic<uint64_t> head;  // only advanced by the writer
+	alignas(64) std::atomic<uint64_t> tail;  // only advanced by the reader
+	alignas(64) std::atomic<int> closed;     // set when either side goes away
+	pid_t owner;                             // server process that created the segment
+};
+
+
+class SHMQueue {
+private:
+	std::string my_name;
+	bool owner;
+	int fd;
+	SHMRing* ring;
+	char* data;
+
+	bool wait_for (bool writing, uint64_t needed);
+	void copy_in (const char* src, uint64_t len);
+	void copy_out (char* dst, uint64_t len);
+
+public:
+	static const uint64_t CAPACITY = 256 * 1024;  // ring bytes, a power of 2
+
+	SHMQueue (const std::string _name, bool _owner);
+	/* The owner (server side) removes any stale segment and creates a fresh one; the other
+	 side waits until a live owner has created it, which mirrors the blocking open() of a FIFO. */
+	~SHMQueue ();
+
+	int push (const char* msg, int len);
+	/* Appends one length-prefixed record. Records larger than the ring are streamed through
+	 it while the reader drains it, so the message size is not limited by CAPACITY. */
+
+	int pop (char* buf, int bufsize);
+	/* Removes one record and copies at most bufsize bytes of it into buf; the rest of the
+	 record is discarded. Returns 0 once the other side has closed the queue. */
+
+	bool readable () const;
+	/* true if a record or the other side's close is waiting, without blocking */
+
+	void close_queue ();
+};
+
+
+class SHMRequestChannel : public RequestChannel {
+private:
+	/* Each direction of the channel is its own shared memory ring, so a request or a reply
+	 is one memcpy in and one memcpy out with no syscalls while both sides are busy. */
+	SHMQueue* wq;
+	SHMQueue* rq;
+
+public:
+	SHMRequestChannel (const std::string _name, const Side _side);
+	~SHMRequestChannel ();
+
+	int cread (void* msgbuf, int msgsize) override;
+	int cwrite (void* msgbuf, int msgsize) override;
+
+	bool can_read () override { return rq->readable(); }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "SeriesIndex.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+static const int LANES = 4;
+
+static inline int floor_log2 (size_t n) {
+	return 63 - __builtin_clzll(n);
+}
+
+/* Min, max and sum of [begin, end) in LANES independent accumulators, so that no lane waits
+for the result of the one before and the compiler can keep them in vector registers; the
+lanes are combined at the end. */
+void SeriesIndex::scan (size_t begin, size_t end, double& lo, double& hi, double& sum) const {
+	const double* v = values.data();
+	double mins[LANES], maxs[LANES], sums[LANES];
+	for (int l = 0; l < LANES; l++) {
+		mins[l] = lo;
+		maxs[l] = hi;
+		sums[l] = 0;
+	}
+	size_t i = begin;
+	for (; i + LANES <= end; i += LANES) {
+		for (int l = 0; l < LANES; l++) {
+			mins[l] = v[i + l] < mins[l] ? v[i + l] : mins[l];
+			maxs[l] = v[i + l] > maxs[l] ? v[i + l] : maxs[l];
+			sums[l] += v[i + l];
+		}
+	}
+	for (; i < end; i++) {
+		mins[0] = min(mins[0], v[i]);
+		maxs[0] = max(maxs[0], v[i]);
+		sums[0] += v[i];
+	}
+	for (int l = 0; l < LANES; l++) {
+		lo = min(lo, mins[l]);
+		hi = max(hi, maxs[l]);
+		sum += sums[l];
+	}
+}
+
+void SeriesIndex::build (vector<double> _values) {
+	values = move(_values);
+	size_t nblocks = values.size() / BLOCK;  // a last partial block is always scanned
+	block_min.assign(1, vector<double>(nblocks));
+	block_max.assign(1, vector<double>(nblocks));
+	block_prefix.assign(nblocks + 1, 0);
+	for (size_t b = 0; b < nblocks; b++) {
+		double lo = values[b * BLOCK], hi = lo, sum = 0;
+		scan(b * BLOCK, (b + 1) * BLOCK, lo, hi, sum);
+		block_min[0][b] = lo;
+		block_max[0][b] = hi;
+		block_prefix[b + 1] = block_prefix[b] + sum;
+	}
+	for (int k = 1; nblocks > 0 && k <= floor_log2(nblocks); k++) {
+		size_t half = (size_t) 1 << (k - 1);
+		size_t n = nblocks - 2 * half + 1;
+		block_min.push_back(vector<double>(n));
+		block_max.push_back(vector<double>(n));
+		for (size_t b = 0; b < n; b++) {
+			block_min[k][b] = min(block_min[k - 1][b], block_min[k - 1][b + half]);
+			block_max[k][b] = max(block_max[k - 1][b], block_max[k - 1][b + half]);
+		}
+	}
+}
+
+ecg_summary SeriesIndex::summary (size_t begin, size_t end) const {
+	double lo = values[begin], hi = lo, sum = 0;
+	size_t first = (begin + BLOCK - 1) / BLOCK, last = end / BLOCK;  // the whole blocks inside
+	if (first >= last) {
+		scan(begin, end, lo, hi, sum);
+	}
+	else {
+		scan(begin, first * BLOCK, lo, hi, sum);
+		scan(last * BLOCK, end, lo, hi, sum);
+		// two runs of 2^k blocks that together cover [first, last), overlapping if need be
+		int k = floor_log2(last - first);
+		size_t second = last - ((size_t) 1 << k);
+		lo = min(lo, min(block_min[k][first], block_min[k][second]));
+		hi = max(hi, max(block_max[k][first], block_max[k][second]));
+		sum += block_prefix[last] - block_prefix[first];
+	}
+	return {lo, hi, sum / (end - begin)};
+}
@@ -0,0 +1,31 @@
+#ifndef _SeriesIndex_H_
+#define _SeriesIndex_H_
+
+#include "common.h"
+
+
+class SeriesIndex {
+private:
+	/* Answers the min, max and mean of any window of a series without reading all of it.
+	 The values are cut into blocks of BLOCK; a sparse table holds the min and max of every
+	 run of 2^k blocks, and a prefix sum the total of the blocks before each one. A window
+	 is then two overlapping runs of whole blocks and at most BLOCK - 1 values at either
+	 end, which are scanned. Building it takes O(n) time and O(n / BLOCK log n) memory. */
+	static const int BLOCK = 64;
+
+	std::vector<double> values;  // a copy in one array, so scans read consecutive doubles
+	std::vector<std::vector<double>> block_min, block_max;  // [k][i]: over blocks i to i + 2^k - 1
+	std::vector<double> block_prefix;  // [i]: the sum of the values of blocks 0 to i - 1
+
+	void scan (size_t begin, size_t end, double& lo, double& hi, double& sum) const;
+
+public:
+	void build (std::vector<double> _values);
+
+	size_t size () const { return values.size(); }
+
+	ecg_summary summary (size_t begin, size_t end) const;
+	/* the summary of the values in [begin, end), which must not be empty */
+};
+
+#endif
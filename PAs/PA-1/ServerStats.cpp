@@ -0,0 +1,171 @@
+#include "ServerStats.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+
+static const char* type_name (int m) {
+	switch (m) {
+		case UNKNOWN_MSG: return "UNKNOWN";
+		case DATA_MSG: return "DATA";
+		case FILE_MSG: return "FILE";
+		case NEWCHANNEL_MSG: return "NEWCHANNEL";
+		case QUIT_MSG: return "QUIT";
+		case DATA_RANGE_MSG: return "DATA_RANGE";
+		case STATS_MSG: return "STATS";
+		case DATA_PAIR_MSG: return "DATA_PAIR";
+		case FILEZ_MSG: return "FILEZ";
+		case FILESUM_MSG: return "FILESUM";
+		case AGGREGATE_MSG: return "AGGREGATE";
+	}
+	return "OTHER";
+}
+
+static const char* phase_name (int p) {
+	static const char* names[] = {"channel read", "request delay", "data lookup", "file i/o"};
+	return names[p];
+}
+
+/*--------------------------------------------------------------------------*/
+/*			MEMBER FUNCTIONS FOR CLASS	L a t e n c y H i s t o g r a m		*/
+/*--------------------------------------------------------------------------*/
+
+LatencyHistogram::LatencyHistogram () : n(0), sum(0), max_value(0) {
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		buckets[i].store(0, memory_order_relaxed);
+	}
+}
+
+int LatencyHistogram::bucket_of (uint64_t value) {
+	if (value < (uint64_t) SUB_BUCKETS) {
+		return value;
+	}
+	int msb = 63 - __builtin_clzll(value);
+	int sub = (value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+	return min((msb - SUB_BITS + 1) * SUB_BUCKETS + sub, NUM_BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::bucket_limit (int bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	int msb = bucket / SUB_BUCKETS + SUB_BITS - 1;
+	int sub = bucket % SUB_BUCKETS;
+	return ((uint64_t) (SUB_BUCKETS + sub + 1) << (msb - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record (uint64_t value) {
+	buckets[bucket_of(value)].fetch_add(1, memory_order_relaxed);
+	n.fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(value, memory_order_relaxed);
+	uint64_t seen = max_value.load(memory_order_relaxed);
+	while (value > seen && !max_value.compare_exchange_weak(seen, value, memory_order_relaxed)) {
+	}
+}
+
+uint64_t LatencyHistogram::mean () const {
+	uint64_t c = count();
+	return c ? sum.load(memory_order_relaxed) / c : 0;
+}
+
+uint64_t LatencyHistogram::percentile (double q) const {
+	uint64_t c = count();
+	if (c == 0) {
+		return 0;
+	}
+	uint64_t rank = max((uint64_t) 1, (uint64_t) (q * c + 0.5));
+	uint64_t seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		seen += buckets[i].load(memory_order_relaxed);
+		if (seen >= rank) {
+			return min(bucket_limit(i), maximum());
+		}
+	}
+	return maximum();
+}
+
+/*--------------------------------------------------------------------------*/
+/*			MEMBER FUNCTIONS FOR CLASS	S e r v e r S t a t s				*/
+/*--------------------------------------------------------------------------*/
+
+ServerStats::ServerStats () : closed_channels(0), closed_requests(0), closed_bytes_in(0), closed_bytes_out(0) {
+	for (int i = 0; i < MAX_TYPES; i++) {
+		bytes_out[i].store(0, memory_order_relaxed);
+	}
+}
+
+ServerStats::~ServerStats () {
+	for (ChannelStats* cs : channels) {
+		delete cs;
+	}
+}
+
+void ServerStats::record_request (MESSAGE_TYPE m, uint64_t ns, uint64_t bytes) {
+	int t = (m >= 0 && m < MAX_TYPES) ? m : UNKNOWN_MSG;
+	latency[t].record(ns);
+	bytes_out[t].fetch_add(bytes, memory_order_relaxed);
+}
+
+void ServerStats::record_phase (Phase p, uint64_t ns) {
+	phases[p].record(ns);
+}
+
+ChannelStats* ServerStats::open_channel (const string name) {
+	ChannelStats* cs = new ChannelStats(name);
+	lock_guard<mutex> lock(mtx);
+	channels.push_back(cs);
+	return cs;
+}
+
+void ServerStats::close_channel (ChannelStats* cs) {
+	lock_guard<mutex> lock(mtx);
+	closed_channels++;
+	closed_requests += cs->requests;
+	closed_bytes_in += cs->bytes_in;
+	closed_bytes_out += cs->bytes_out;
+	channels.remove(cs);
+	delete cs;
+}
+
+static void print_row (ostringstream& out, const char* name, const LatencyHistogram& h) {
+	out << left << setw(16) << name << right << setw(10) << h.count()
+		<< setw(10) << h.mean() / 1000.0 << setw(10) << h.percentile(0.5) / 1000.0
+		<< setw(10) << h.percentile(0.99) / 1000.0 << setw(10) << h.percentile(0.999) / 1000.0
+		<< setw(10) << h.maximum() / 1000.0;
+}
+
+string ServerStats::report () {
+	ostringstream out;
+	out << fixed << setprecision(1);
+	out << left << setw(16) << "request" << right << setw(10) << "count" << setw(10) << "mean us"
+		<< setw(10) << "p50 us" << setw(10) << "p99 us" << setw(10) << "p999 us" << setw(10) << "max us"
+		<< setw(14) << "bytes out" << endl;
+	for (int t = 0; t < MAX_TYPES; t++) {
+		if (latency[t].count()) {
+			print_row(out, type_name(t), latency[t]);
+			out << setw(14) << bytes_out[t].load(memory_order_relaxed) << endl;
+		}
+	}
+	for (int p = 0; p < NUM_PHASES; p++) {
+		if (phases[p].count()) {
+			print_row(out, phase_name(p), phases[p]);
+			out << endl;
+		}
+	}
+
+	lock_guard<mutex> lock(mtx);
+	out << left << setw(16) << "channel" << right << setw(10) << "requests" << setw(14) << "bytes in"
+		<< setw(14) << "bytes out" << endl;
+	for (ChannelStats* cs : channels) {
+		out << left << setw(16) << cs->name << right << setw(10) << cs->requests
+			<< setw(14) << cs->bytes_in << setw(14) << cs->bytes_out << endl;
+	}
+	if (closed_channels) {
+		string closed = "(" + to_string(closed_channels) + " closed)";
+		out << left << setw(16) << closed << right << setw(10) << closed_requests
+			<< setw(14) << closed_bytes_in << setw(14) << closed_bytes_out << endl;
+	}
+	return out.str();
+}
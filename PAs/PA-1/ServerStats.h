@@ -0,0 +1,90 @@
+#ifndef _ServerStats_H_
+#define _ServerStats_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+
+
+inline uint64_t now_ns () {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+class LatencyHistogram {
+private:
+	/* Log-linear buckets: the power of two of a value picks a group of SUB_BUCKETS linear
+	 buckets, which bounds the error of a percentile to 1/SUB_BUCKETS of its value. All
+	 counters are relaxed atomics, so recording from many threads never takes a lock. */
+	static const int SUB_BITS = 3;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	static const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+	std::atomic<uint64_t> buckets[NUM_BUCKETS];
+	std::atomic<uint64_t> n;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max_value;
+
+	static int bucket_of (uint64_t value);
+	static uint64_t bucket_limit (int bucket);
+
+public:
+	LatencyHistogram ();
+
+	void record (uint64_t value);
+	uint64_t count () const { return n.load(std::memory_order_relaxed); }
+	uint64_t mean () const;
+	uint64_t maximum () const { return max_value.load(std::memory_order_relaxed); }
+	uint64_t percentile (double q) const;
+	/* upper limit of the bucket holding the q-quantile (0 < q <= 1), 0 if empty */
+};
+
+
+struct ChannelStats {
+	std::string name;
+	std::atomic<uint64_t> requests;
+	std::atomic<uint64_t> bytes_in;
+	std::atomic<uint64_t> bytes_out;
+
+	ChannelStats (const std::string _name) : name(_name), requests(0), bytes_in(0), bytes_out(0) {}
+};
+
+
+class ServerStats {
+public:
+	// where the time of a request goes, besides the per-type end-to-end latency
+	enum Phase {READ_PHASE, DELAY_PHASE, LOOKUP_PHASE, FILE_PHASE, NUM_PHASES};
+	static const int MAX_TYPES = 16;  // MESSAGE_TYPE values that get their own statistics
+
+private:
+	LatencyHistogram latency[MAX_TYPES];
+	std::atomic<uint64_t> bytes_out[MAX_TYPES];
+	LatencyHistogram phases[NUM_PHASES];
+
+	std::mutex mtx;  // guards the channel list and the totals of closed channels
+	std::list<ChannelStats*> channels;
+	uint64_t closed_channels, closed_requests, closed_bytes_in, closed_bytes_out;
+
+public:
+	ServerStats ();
+	~ServerStats ();
+
+	void record_request (MESSAGE_TYPE m, uint64_t ns, uint64_t bytes);
+	void record_phase (Phase p, uint64_t ns);
+
+	ChannelStats* open_channel (const std::string name);
+	void close_channel (ChannelStats* cs);
+	/* the counters of a closed channel are folded into a single total, so the statistics
+	 stay the same size however many channels come and go */
+
+	std::string report ();
+	/* human-readable summary: latency percentiles per message type and phase, and the
+	 traffic of every open channel */
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "SocketRequestChannel.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+using namespace std;
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL  // a vanished peer is an error return, not a SIGPIPE
+#else
+#define SEND_FLAGS 0
+#endif
+
+/*--------------------------------------------------------------------------*/
+/*	CONSTRUCTOR/DESTRUCTOR FOR CLASS	S o c k e t R e q u e s t C h a n n e l	*/
+/*--------------------------------------------------------------------------*/
+
+SocketRequestChannel::SocketRequestChannel (const string _name, const Side _side, const function<bool()>& give_up)
+	: RequestChannel(_name, _side), fd(-1) {
+	path = "sock_" + my_name;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	if (_side == SERVER_SIDE) {
+		int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		unlink(path.c_str());
+		if (lfd < 0 || bind(lfd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0) {
+			EXITONERROR(path);
+		}
+		// waits for the client in slices, asking give_up in between
+		struct pollfd p = {lfd, POLLIN, 0};
+		while (give_up && poll(&p, 1, 10) <= 0) {
+			if (give_up()) {
+				close(lfd);
+				unlink(path.c_str());
+				opened = false;
+				return;
+			}
+		}
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0) {
+			EXITONERROR(path);
+		}
+		close(lfd);
+		unlink(path.c_str());
+	}
+	else {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			EXITONERROR(path);
+		}
+		// the server may not be listening yet, like a FIFO whose other end is not open
+		while (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+			if (errno != ENOENT && errno != ECONNREFUSED) {
+				EXITONERROR(path);
+			}
+			usleep(100);
+		}
+	}
+}
+
+SocketRequestChannel::~SocketRequestChannel () {
+	close(fd);
+}
+
+/*--------------------------------------------------------------------------*/
+/*	MEMBER FUNCTIONS FOR CLASS	S o c k e t R e q u e s t C h a n n e l		*/
+/*--------------------------------------------------------------------------*/
+
+int SocketRequestChannel::read_fully (char* buf, int len) {
+	int done = 0;
+	while (done < len) {
+		ssize_t n = recv(fd, buf + done, len - done, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return n;
+		}
+		done += n;
+	}
+	return done;
+}
+
+int SocketRequestChannel::write_fully (const char* buf, int len) {
+	int done = 0;
+	while (done < len) {
+		ssize_t n = send(fd, buf + done, len - done, SEND_FLAGS);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			return -1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+int SocketRequestChannel::cread (void* msgbuf, int msgsize) {
+	struct iovec iov = {msgbuf, (size_t) msgsize};
+	return creadv(&iov, 1);
+}
+
+int SocketRequestChannel::cwrite (void* msgbuf, int msgsize) {
+	struct iovec iov = {msgbuf, (size_t) msgsize};
+	return cwritev(&iov, 1);
+}
+
+int SocketRequestChannel::creadv (const struct iovec* iov, int iovcnt) {
+	uint32_t total = 0;
+	int n = read_fully((char*) &total, sizeof(total));
+	if (n <= 0) {
+		return n;
+	}
+
+	uint32_t keep = 0;
+	for (int i = 0; i < iovcnt && keep < total; i++) {
+		int len = min((size_t) (total - keep), iov[i].iov_len);
+		if ((n = read_fully((char*) iov[i].iov_base, len)) < len) {
+			return n < 0 ? -1 : 0;
+		}
+		keep += len;
+	}
+	// drop whatever does not fit into the caller's buffers
+	char sink[4096];
+	for (uint32_t left = total - keep; left > 0; ) {
+		int chunk = min(left, (uint32_t) sizeof(sink));
+		if (read_fully(sink, chunk) < chunk) {
+			return -1;
+		}
+		left -= chunk;
+	}
+	return keep;
+}
+
+int SocketRequestChannel::cwritev (const struct iovec* iov, int iovcnt) {
+	if (iovcnt > MAX_IOV) {
+		return -1;
+	}
+	uint32_t total = 0;
+	struct iovec vec[MAX_IOV + 1];
+	vec[0].iov_base = &total;
+	vec[0].iov_len = sizeof(total);
+	for (int i = 0; i < iovcnt; i++) {
+		vec[i + 1] = iov[i];
+		total += iov[i].iov_len;
+	}
+	// header and payload leave in one syscall unless the socket buffer is full
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	int first = 0;
+	while (first <= iovcnt) {
+		msg.msg_iov = vec + first;
+		msg.msg_iovlen = iovcnt + 1 - first;
+		ssize_t n = sendmsg(fd, &msg, SEND_FLAGS);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			return -1;
+		}
+		first += skip_iov(vec + first, iovcnt + 1 - first, n);
+	}
+	return total;
+}
+
+int SocketRequestChannel::csendfile (int file_fd, __int64_t offset, int length, char* buf) {
+#ifdef __linux__
+	struct stat st;
+	if (fstat(file_fd, &st) == 0 && offset + length <= st.st_size) {
+		// the length prefix is written before any payload, so the file must cover all of it
+		uint32_t total = length;
+		if (write_fully((char*) &total, sizeof(total)) < 0) {
+			return -1;
+		}
+		off_t off = offset;
+		int done = 0;
+		while (done < length) {
+			ssize_t n = sendfile(fd, file_fd, &off, length - done);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				return -1;
+			}
+			done += n;
+		}
+		return done;
+	}
+#endif
+	return RequestChannel::csendfile(file_fd, offset, length, buf);
+}
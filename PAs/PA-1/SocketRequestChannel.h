@@ -0,0 +1,34 @@
+#ifndef _SocketRequestChannel_H_
+#define _SocketRequestChannel_H_
+
+#include "RequestChannel.h"
+
+#include <stdint.h>
+
+
+class SocketRequestChannel : public RequestChannel {
+private:
+	/* A connected UNIX-domain stream socket. The server side listens on "sock_<name>" and
+	 accepts exactly one connection, then removes the path again. Since a stream has no
+	 message boundaries, every message is sent with a 4-byte length in front of it. */
+	std::string path;
+	int fd;
+
+	int read_fully (char* buf, int len);
+	int write_fully (const char* buf, int len);
+
+public:
+	SocketRequestChannel (const std::string _name, const Side _side, const std::function<bool()>& give_up = nullptr);
+	~SocketRequestChannel ();
+
+	int cread (void* msgbuf, int msgsize) override;
+	int cwrite (void* msgbuf, int msgsize) override;
+	int cwritev (const struct iovec* iov, int iovcnt) override;
+	int creadv (const struct iovec* iov, int iovcnt) override;
+	int csendfile (int file_fd, __int64_t offset, int length, char* buf) override;
+	/* On Linux the payload goes from the file to the socket with sendfile. */
+
+	int read_fd () override { return fd; }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "TransferManifest.h"
+#include "FileTransfer.h"
+#include "Checksum.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+static const int BATCH_CHUNKS = 256;  // completed chunks between two appends to the manifest
+
+TransferManifest::TransferManifest (const string& _outpath, __int64_t _filesize, int _m)
+	: outpath(_outpath), path(_outpath + ".manifest"), filesize(_filesize), m(_m), fd(-1), resumed(false),
+	  range_begin(0), range_end(0), unwritten(0), n_verified(0), n_failed(0) {
+	__int64_t nchunks = (filesize + m - 1) / m;
+
+	// the ranges of earlier runs, unless the output file is gone or the size changed
+	vector<pair<__int64_t, __int64_t>> done;
+	struct stat st;
+	ifstream in(path);
+	__int64_t size = -1;
+	if (stat(outpath.c_str(), &st) == 0 && in >> size && size == filesize) {
+		resumed = true;
+		__int64_t begin, end;
+		// a line cut short by a dying run is either read as a shorter range or not at all
+		while (in >> begin >> end) {
+			if (0 <= begin && begin < end && end <= filesize) {
+				done.push_back(make_pair(begin, end));
+			}
+		}
+	}
+	sort(done.begin(), done.end());
+
+	// a chunk is done if one merged range covers all of it
+	size_t r = 0;
+	__int64_t covered_begin = 0, covered_end = 0;
+	for (__int64_t chunk = 0; chunk < nchunks; chunk++) {
+		__int64_t begin = chunk * m, end = min(begin + m, filesize);
+		while (r < done.size() && done[r].first < end) {
+			if (done[r].first > covered_end) {
+				covered_begin = done[r].first;
+			}
+			covered_end = max(covered_end, done[r].second);
+			r++;
+		}
+		if (!(covered_begin <= begin && end <= covered_end)) {
+			todo.push_back(chunk);
+		}
+	}
+
+	/* a new transfer creates its output file before the manifest, so a run that dies while
+	it still fetches the checksums leaves both behind and the next run resumes */
+	if (!resumed) {
+		int out = open(outpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out < 0) {
+			EXITONERROR(outpath);
+		}
+		close(out);
+	}
+	fd = resumed ? open(path.c_str(), O_WRONLY | O_APPEND) : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		EXITONERROR(path);
+	}
+	if (!resumed) {
+		pending = to_string(filesize) + "\n";
+		write_pending();
+	}
+}
+
+TransferManifest::~TransferManifest () {
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+bool TransferManifest::fetch_checksums (RequestChannel* chan, const string& filename) {
+	vector<uint64_t> batch(filesum_capacity(m));
+	if (batch.empty()) {
+		cerr << "A chunk of " << m << " bytes cannot hold a FILESUM_MSG reply" << endl;
+		return false;
+	}
+	FileRequestEncoder enc(filename, FILESUM_MSG);
+	sums.assign((filesize + m - 1) / m, 0);
+	for (size_t i = 0; i < todo.size(); ) {
+		// the reply covers the chunks from todo[i] on, whether they are still to fetch or not
+		__int64_t first = todo[i];
+		int n = request_checksums(chan, enc, first * m, m, batch.data());
+		if (n <= 0) {
+			cerr << "Could not get the checksums of " << filename << endl;
+			return false;
+		}
+		for (; i < todo.size() && todo[i] < first + n; i++) {
+			sums[todo[i]] = batch[todo[i] - first];
+		}
+	}
+	return true;
+}
+
+bool TransferManifest::verify (__int64_t offset, const char* data, int len) {
+	if (chunk_checksum(data, len) == sums[offset / m]) {
+		n_verified++;
+		return true;
+	}
+	n_failed++;
+	cerr << "The chunk at offset " << offset << " of " << outpath << " does not match the server's checksum" << endl;
+	return false;
+}
+
+void TransferManifest::complete (__int64_t offset, int len) {
+	lock_guard<mutex> lock(mtx);
+	if (offset == range_end && range_end > range_begin) {
+		range_end += len;
+	}
+	else {
+		append_range();
+		range_begin = offset;
+		range_end = offset + len;
+	}
+	if (++unwritten >= BATCH_CHUNKS) {
+		append_range();
+		write_pending();
+		unwritten = 0;
+	}
+}
+
+// moves the last range into pending
+void TransferManifest::append_range () {
+	if (range_end > range_begin) {
+		pending += to_string(range_begin) + " " + to_string(range_end) + "\n";
+	}
+	range_begin = range_end = 0;
+}
+
+void TransferManifest::write_pending () {
+	if (!pending.empty() && write(fd, pending.data(), pending.size()) != (ssize_t) pending.size()) {
+		EXITONERROR(path);
+	}
+	pending.clear();
+}
+
+bool TransferManifest::finish () {
+	lock_guard<mutex> lock(mtx);
+	append_range();
+	write_pending();
+	close(fd);
+	fd = -1;
+	if (n_verified == (__int64_t) todo.size()) {
+		unlink(path.c_str());
+		return true;
+	}
+	return false;
+}
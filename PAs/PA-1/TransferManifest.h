@@ -0,0 +1,66 @@
+#ifndef _TransferManifest_H_
+#define _TransferManifest_H_
+
+#include "RequestChannel.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+
+class TransferManifest {
+private:
+	/* The record of a resumable file transfer (client -r), kept next to the output file as
+	 "<output>.manifest". Its first line is the size of the file, every other line a range
+	 "begin end" of bytes that arrived and matched the server's checksum. The ranges are
+	 appended in batches, after their bytes were written, so a run that dies loses at most
+	 the last batch and only fetches those chunks again. Once every chunk arrived intact
+	 the manifest is removed. */
+	std::string outpath;
+	std::string path;
+	__int64_t filesize;
+	int m;
+	int fd;
+	bool resumed;
+	std::vector<__int64_t> todo;  // indices of the chunks of m bytes still to fetch
+	std::vector<uint64_t> sums;   // the server's checksum of each chunk, by index
+	std::mutex mtx;
+	std::string pending;          // ranges not appended to the manifest yet
+	__int64_t range_begin, range_end;  // the last range, grown while chunks complete in order
+	int unwritten;                // chunks completed since the last append
+	std::atomic<__int64_t> n_verified, n_failed;
+
+	void append_range ();
+	void write_pending ();
+
+public:
+	TransferManifest (const std::string& outpath, __int64_t _filesize, int _m);
+	/* Picks up the manifest of outpath if it exists, describes a file of this size and
+	 outpath is still there; otherwise creates outpath empty and starts a new manifest. */
+	~TransferManifest ();
+
+	bool resuming () const { return resumed; }
+	/* whether the output file keeps what earlier runs wrote */
+
+	const std::vector<__int64_t>& chunks () const { return todo; }
+	/* the chunks of m bytes to fetch, in order */
+
+	bool fetch_checksums (RequestChannel* chan, const std::string& filename);
+	/* asks the server for the checksums of the chunks to fetch, in batches of FILESUM_MSG */
+
+	bool verify (__int64_t offset, const char* data, int len);
+	/* Checks the chunk at offset, a multiple of m, against the server's checksum. A chunk
+	 that does not match is reported on cerr and counted as failed. */
+
+	void complete (__int64_t offset, int len);
+	/* records a verified chunk once its bytes are in the output file; thread-safe */
+
+	__int64_t missing () const { return todo.size() - n_verified; }
+	__int64_t failures () const { return n_failed; }
+
+	bool finish ();
+	/* Appends what is pending. Removes the manifest and returns true if every chunk
+	 arrived intact, otherwise keeps it for the next run. */
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+	Checks that the client's steady-state file transfer loop makes no heap allocations.
+	Every operator new of this process is counted while transfer_chunks pulls a BIMDC
+	file from a server over each transport; after one warm-up chunk the count must not
+	move, and the received file must match the original byte for byte. Exits with 0 if
+	every transport passes.
+*/
+#include "common.h"
+#include "RequestChannel.h"
+#include "FileTransfer.h"
+
+#include <atomic>
+#include <iterator>
+#include <new>
+#include <sys/wait.h>
+
+using namespace std;
+
+
+static atomic<long> allocations(0);
+
+static void* counted_alloc (size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new (size_t size) { return counted_alloc(size); }
+void* operator new[] (size_t size) { return counted_alloc(size); }
+void operator delete (void* p) noexcept { free(p); }
+void operator delete[] (void* p) noexcept { free(p); }
+void operator delete (void* p, size_t) noexcept { free(p); }
+void operator delete[] (void* p, size_t) noexcept { free(p); }
+
+
+// true if both files hold the same bytes
+static bool same_contents (const string& a, const string& b) {
+	ifstream fa(a, ios::binary), fb(b, ios::binary);
+	if (!fa || !fb) {
+		return false;
+	}
+	return string(istreambuf_iterator<char>(fa), {}) == string(istreambuf_iterator<char>(fb), {});
+}
+
+// transfers filename with m-byte chunks over one transport, returns the allocations of the loop
+long allocations_during_transfer (char ipc_type, const string& filename, int m) {
+	string m_str = to_string(m);
+	string i_str(1, ipc_type);
+	int pid = fork();
+	if (pid == 0) {
+		execl("./server", "server", "-m", m_str.c_str(), "-i", i_str.c_str(), (char*) nullptr);
+		perror("exec failed");
+		_exit(127);
+	}
+
+	RequestChannel* chan = create_channel(ipc_type, "control", RequestChannel::CLIENT_SIDE);
+	FileRequestEncoder enc(filename);
+	__int64_t filesize = request_file_size(chan, enc);
+	string outname = "received/alloc_test.out";
+	int outfd = open(outname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	vector<char> buf(m);
+
+	// the first chunk may set up lazily allocated state, e.g. in the C library
+	long used = -1;
+	if (filesize > m && transfer_chunks(chan, enc, 0, m, m, buf.data(), outfd)) {
+		long before = allocations;
+		bool ok = transfer_chunks(chan, enc, m, filesize, m, buf.data(), outfd);
+		used = ok ? allocations - before : -1;
+	}
+	close(outfd);
+	bool same = same_contents(outname, "BIMDC/" + filename);
+	remove(outname.c_str());
+
+	MESSAGE_TYPE q = QUIT_MSG;
+	chan->cwrite(&q, sizeof(MESSAGE_TYPE));
+	delete chan;
+	waitpid(pid, NULL, 0);
+	return same ? used : -1;
+}
+
+int main () {
+	string types = "fsu";
+#ifdef __linux__
+	types += "q";
+#endif
+	int failed = 0;
+	for (char t : types) {
+		long n = allocations_during_transfer(t, "1.csv", 4096);
+		if (n == 0) {
+			cout << "alloc_test -i " << t << ": passed, no allocations in the transfer loop" << endl;
+		}
+		else {
+			cout << "alloc_test -i " << t << ": FAILED, " << (n < 0 ? string("transfer failed") : to_string(n) + " allocations") << endl;
+			failed++;
+		}
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/*
+	Steady-state IPC benchmark. For every combination of transport (-i), buffer capacity
+	(-m) and channel count (-c) it starts one server, opens the channels and only then
+	starts measuring, so fork/exec, server startup and the dataset load stay out of the
+	numbers. Each channel is driven by its own thread:
+		data - DATA_MSG round trips, the latency of a single request
+		file - FILE_MSG chunks of m bytes from a scratch file, the transfer rate
+	After -W warmup operations per channel, -n operations per channel are timed, and this
+	is repeated -r times. Every repetition is one CSV row (or JSON object with -o *.json):
+	its operations per second, bytes per second and latency percentiles.
+
+	The server runs with "-D none" unless -D says otherwise, so the data numbers are the
+	cost of the IPC path rather than of the simulated lookup delay. Both binaries use the
+	makefile's CXXFLAGS, so compare numbers only between builds with the same flags.
+
+	-A lists the server's thread placements to compare, separated by '/': "none" leaves its
+	threads unpinned, anything else is passed on as its -A (e.g. -A none/all/0-1). The
+	pinning column of the CSV writes the commas of a CPU list as '+'.
+
+	./bench -i fsuq -m 256,4096,65536 -c 1,4 -n 2000 -W 200 -r 3 -o bench_results.csv
+	python3 PlotResults.py bench_results.csv
+*/
+#include "common.h"
+#include "RequestChannel.h"
+#include "FileTransfer.h"
+#include "ServerStats.h"
+#include "CorePlacement.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+
+using namespace std;
+
+
+struct BenchConfig {
+	char ipc_type;
+	string workload;
+	int m;
+	int channels;
+	string cpus;  // the server's -A, "none" for unpinned threads
+};
+
+struct BenchResult {
+	BenchConfig config;
+	int rep;
+	uint64_t ops;
+	double seconds;
+	uint64_t bytes;
+	unique_ptr<LatencyHistogram> latency;
+};
+
+const char* BENCH_FILE = "bench.bin";  // scratch file in BIMDC for the file workload
+const __int64_t BENCH_FILE_SIZE = 16 << 20;
+
+
+vector<int> parse_list (const string& list) {
+	vector<int> values;
+	stringstream ss(list);
+	string item;
+	while (getline(ss, item, ',')) {
+		values.push_back(atoi(item.c_str()));
+	}
+	return values;
+}
+
+// one channel's share of a repetition: warmup operations first, then ops timed ones
+void drive_channel (RequestChannel* chan, const BenchConfig& cfg, int warmup, int ops, int index, LatencyHistogram* latency) {
+	FileRequestEncoder enc(BENCH_FILE);
+	vector<char> buf(cfg.m);
+	// the channels read different parts of the file, so no two request the same chunk
+	__int64_t nchunks = BENCH_FILE_SIZE / cfg.m;
+	__int64_t chunk = index * (nchunks / max(cfg.channels, 1));
+	for (int i = 0; i < warmup + ops; i++) {
+		uint64_t start = now_ns();
+		if (cfg.workload == "data") {
+			datamsg d(1 + i % NUM_PERSONS, (i % 15000) * 0.004, 1 + i % 2);
+			chan->cwrite(&d, sizeof(datamsg));
+			double value;
+			chan->cread(&value, sizeof(double));
+		}
+		else {
+			enc.send(chan, (chunk++ % nchunks) * cfg.m, cfg.m);
+			chan->cread(buf.data(), cfg.m);
+		}
+		if (i >= warmup) {
+			latency->record(now_ns() - start);
+		}
+	}
+}
+
+// runs every repetition of one configuration against a server of its own
+vector<BenchResult> run_config (const BenchConfig& cfg, const string& delay, int warmup, int ops, int reps) {
+	string m_str = to_string(cfg.m);
+	string i_str(1, cfg.ipc_type);
+	int pid = fork();
+	if (pid == 0) {
+		vector<const char*> args = {"server", "-m", m_str.c_str(), "-i", i_str.c_str(), "-D", delay.c_str()};
+		if (cfg.cpus != "none") {
+			args.push_back("-A");
+			args.push_back(cfg.cpus.c_str());
+		}
+		args.push_back(nullptr);
+		execv("./server", (char* const*) args.data());
+		perror("exec failed");
+		_exit(127);
+	}
+
+	RequestChannel* control = create_channel(cfg.ipc_type, "control", RequestChannel::CLIENT_SIDE);
+	vector<RequestChannel*> chans;
+	for (int c = 0; c < cfg.channels; c++) {
+		MESSAGE_TYPE nc = NEWCHANNEL_MSG;
+		control->cwrite(&nc, sizeof(MESSAGE_TYPE));
+		char name[64] = {0};
+		control->cread(name, sizeof(name));
+		if (name[0] == 0) {
+			EXITONERROR("The server refused a new channel");
+		}
+		chans.push_back(create_channel(cfg.ipc_type, name, RequestChannel::CLIENT_SIDE));
+	}
+
+	vector<BenchResult> results;
+	for (int r = 0; r < reps; r++) {
+		BenchResult res = {cfg, r + 1, (uint64_t) ops * cfg.channels, 0, 0, make_unique<LatencyHistogram>()};
+		vector<thread> drivers;
+		uint64_t start = now_ns();
+		for (int c = 0; c < cfg.channels; c++) {
+			// the warmup of a repetition is part of its wall time, only the first one is left out
+			drivers.push_back(thread(drive_channel, chans[c], cref(cfg), r == 0 ? warmup : 0, ops, c, res.latency.get()));
+		}
+		for (thread& d : drivers) {
+			d.join();
+		}
+		res.seconds = (now_ns() - start) / 1e9;
+		res.bytes = res.ops * (cfg.workload == "data" ? sizeof(double) : cfg.m);
+		results.push_back(move(res));
+	}
+
+	for (RequestChannel* chan : chans) {
+		MESSAGE_TYPE q = QUIT_MSG;
+		chan->cwrite(&q, sizeof(MESSAGE_TYPE));
+		delete chan;
+	}
+	MESSAGE_TYPE q = QUIT_MSG;
+	control->cwrite(&q, sizeof(MESSAGE_TYPE));
+	delete control;
+	waitpid(pid, NULL, 0);
+	return results;
+}
+
+void write_csv (ostream& out, const vector<BenchResult>& results) {
+	out << "transport,workload,m,channels,rep,ops,seconds,ops_per_s,bytes_per_s,mean_us,p50_us,p99_us,p999_us,max_us,pinning" << endl;
+	for (const BenchResult& r : results) {
+		string pinning = r.config.cpus;
+		replace(pinning.begin(), pinning.end(), ',', '+');
+		out << r.config.ipc_type << ',' << r.config.workload << ',' << r.config.m << ',' << r.config.channels << ','
+			<< r.rep << ',' << r.ops << ',' << r.seconds << ',' << r.ops / r.seconds << ',' << r.bytes / r.seconds << ','
+			<< r.latency->mean() / 1000.0 << ',' << r.latency->percentile(0.5) / 1000.0 << ','
+			<< r.latency->percentile(0.99) / 1000.0 << ',' << r.latency->percentile(0.999) / 1000.0 << ','
+			<< r.latency->maximum() / 1000.0 << ',' << pinning << endl;
+	}
+}
+
+void write_json (ostream& out, const vector<BenchResult>& results) {
+	out << "[" << endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		out << "  {\"transport\": \"" << r.config.ipc_type << "\", \"workload\": \"" << r.config.workload
+			<< "\", \"m\": " << r.config.m << ", \"channels\": " << r.config.channels << ", \"rep\": " << r.rep
+			<< ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"ops_per_s\": " << r.ops / r.seconds
+			<< ", \"bytes_per_s\": " << r.bytes / r.seconds << ", \"mean_us\": " << r.latency->mean() / 1000.0
+			<< ", \"p50_us\": " << r.latency->percentile(0.5) / 1000.0 << ", \"p99_us\": " << r.latency->percentile(0.99) / 1000.0
+			<< ", \"p999_us\": " << r.latency->percentile(0.999) / 1000.0 << ", \"max_us\": " << r.latency->maximum() / 1000.0
+			<< ", \"pinning\": \"" << r.config.cpus << "\"}" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	out << "]" << endl;
+}
+
+int main (int argc, char* argv[]) {
+	string types = "fsu";
+#ifdef __linux__
+	types += "q";
+#endif
+	string workloads = "data,file";
+	vector<int> sizes = {256, 4096, 65536};
+	vector<int> channel_counts = {1, 4};
+	int ops = 2000, warmup = 200, reps = 3;
+	string delay = "none";
+	vector<string> placements = {"none"};
+	string output = "";
+
+	int opt;
+	while ((opt = getopt(argc, argv, "i:k:m:c:n:W:r:D:A:o:")) != -1) {
+		switch (opt) {
+			case 'i':
+				types = optarg;
+				break;
+			case 'k':
+				workloads = optarg;
+				break;
+			case 'm':
+				sizes = parse_list(optarg);
+				break;
+			case 'c':
+				channel_counts = parse_list(optarg);
+				break;
+			case 'n':
+				ops = max(1, atoi(optarg));
+				break;
+			case 'W':
+				warmup = max(0, atoi(optarg));
+				break;
+			case 'r':
+				reps = max(1, atoi(optarg));
+				break;
+			case 'D':
+				delay = optarg;
+				break;
+			case 'A':
+				placements = split(optarg, '/');
+				break;
+			case 'o':
+				output = optarg;
+				break;
+		}
+	}
+	for (char t : types) {
+		if (!valid_ipc_type(t)) {
+			cerr << "Unknown IPC type " << t << ", use " << IPC_TYPE_USAGE << endl;
+			return 1;
+		}
+	}
+	for (const string& cpus : placements) {
+		CorePlacement check;
+		if (cpus != "none" && !check.configure(cpus)) {
+			return 1;  // the server would refuse it and leave us waiting for its control channel
+		}
+	}
+
+	// the scratch file, the same bytes for every configuration
+	{
+		ofstream f(string("BIMDC/") + BENCH_FILE, ios::binary);
+		vector<char> block(1 << 20);
+		for (size_t i = 0; i < block.size(); i++) {
+			block[i] = (char) (i * 2654435761u >> 24);
+		}
+		for (__int64_t done = 0; done < BENCH_FILE_SIZE; done += block.size()) {
+			f.write(block.data(), block.size());
+		}
+	}
+
+	vector<BenchResult> results;
+	for (char t : types) {
+		for (const string& workload : {string("data"), string("file")}) {
+			if (workloads.find(workload) == string::npos) {
+				continue;
+			}
+			for (int m : sizes) {
+				if (workload == "data" && m != sizes.front()) {
+					continue;  // a data request does not depend on the buffer capacity
+				}
+				if (m < (int) sizeof(filemsg) + 16 || BENCH_FILE_SIZE / m < 1) {
+					cerr << "Skipping m = " << m << ", too small for a request or too big for the file" << endl;
+					continue;
+				}
+				for (int c : channel_counts) {
+					for (const string& cpus : placements) {
+						BenchConfig cfg = {t, workload, m, max(c, 1), cpus};
+						cerr << "-i " << t << " " << workload << " -m " << m << " channels " << cfg.channels << " -A " << cpus << endl;
+						for (BenchResult& r : run_config(cfg, delay, warmup, ops, reps)) {
+							results.push_back(move(r));
+						}
+					}
+				}
+			}
+		}
+	}
+	remove((string("BIMDC/") + BENCH_FILE).c_str());
+
+	bool json = output.size() > 5 && output.substr(output.size() - 5) == ".json";
+	if (output.empty()) {
+		write_csv(cout, results);
+	}
+	else {
+		ofstream out(output);
+		if (json) {
+			write_json(out, results);
+		}
+		else {
+			write_csv(out, results);
+		}
+		cerr << "Results saved to " << output << endl;
+	}
+	return 0;
+}
@@ -33,6 +33,83 @@ if ! ls BIMDC/*.csv >/dev/null 2>&1; then
   exit 1
 fi
 
+# ./benchmark_tests.sh transports [m]
+# Runs the same workload over every IPC transport (-i) and records
+# "transport workload bytes seconds" lines in transport_results.txt:
+#   data - ./client -n 2000 -p 1 -w 1, i.e. 2000 DATA_MSG round trips over one
+#          channel (-p 1 alone fetches ranges, about 66 round trips)
+#   file - a 10 MB file pulled with -m <m> byte chunks (default 60000)
+# DELAY=<model> passes -D <model> to the server, e.g. DELAY=none for the bare
+# IPC cost of a data request without the simulated lookup latency.
+if [ "${1:-}" = "transports" ]; then
+  M="${2:-60000}"
+  TRANSPORT_FILE="transport_results.txt"
+  : > "$TRANSPORT_FILE"
+  TRANSPORTS="f s u"
+  if [ "$(uname)" = "Linux" ]; then
+    TRANSPORTS="f q s u"
+  fi
+  head -c 10000000 /dev/urandom > BIMDC/bench.bin
+
+  echo -e "\n${YELLOW}Comparing transports: ${TRANSPORTS} (m=${M})${NC}\n"
+  printf "%-10s %-6s %12s %10s %14s\n" transport work bytes seconds "bytes/s | us/op"
+  for t in $TRANSPORTS; do
+    for work in data file; do
+      if [ "$work" = "data" ]; then
+        args="-i $t -n 2000 -p 1 -w 1${DELAY:+ -D $DELAY}"; bytes=$((2000 * 8)); ops=2000
+      else
+        args="-i $t -f bench.bin -m $M"; bytes=10000000; ops=$(( (bytes + M - 1) / M ))
+      fi
+      # bash's own time keyword, so this mode works without /usr/bin/time
+      TIMEFORMAT=%R
+      if ! secs=$( { time $TIMEOUT ./client $args >/dev/null 2>&1; } 2>&1 ); then
+        secs=0
+      fi
+      echo "$t $work $bytes $secs" >> "$TRANSPORT_FILE"
+      if [ "$work" = "data" ]; then
+        rate=$(awk -v s="$secs" -v n="$ops" 'BEGIN{ if (s > 0) printf "%.1f us/op", s * 1e6 / n; else print "FAILED" }')
+      else
+        rate=$(awk -v s="$secs" -v b="$bytes" 'BEGIN{ if (s > 0) printf "%.0f B/s", b / s; else print "FAILED" }')
+      fi
+      printf "%-10s %-6s %12s %10s %14s\n" "$t" "$work" "$bytes" "$secs" "$rate"
+    done
+  done
+  rm -f BIMDC/bench.bin received/bench.bin
+  echo -e "\nResults saved to: $TRANSPORT_FILE"
+  exit 0
+fi
+
+# ./benchmark_tests.sh chunks [transport]
+# Pulls a 32 MB file with growing chunk sizes (-m) and records "m seconds" lines
+# in chunk_results.txt. FIFOs are resized to hold a whole chunk (-P), up to the
+# limit in /proc/sys/fs/pipe-max-size.
+if [ "${1:-}" = "chunks" ]; then
+  T="${2:-f}"
+  CHUNK_FILE="chunk_results.txt"
+  : > "$CHUNK_FILE"
+  PIPE_MAX=$(cat /proc/sys/fs/pipe-max-size 2>/dev/null || echo 0)
+  head -c 32000000 /dev/urandom > BIMDC/bench.bin
+
+  echo -e "\n${YELLOW}Comparing chunk sizes over -i ${T}${NC}\n"
+  printf "%-10s %10s %14s\n" m seconds "bytes/s"
+  for M in 4096 16384 65536 262144 1048576 4194304; do
+    args="-i $T -f bench.bin -m $M"
+    if [ "$T" = "f" ] && [ "$PIPE_MAX" -gt 0 ]; then
+      args="$args -P $(( M + 4 < PIPE_MAX ? M + 4 : PIPE_MAX ))"
+    fi
+    TIMEFORMAT=%R
+    if ! secs=$( { time $TIMEOUT ./client $args >/dev/null 2>&1; } 2>&1 ) || ! cmp -s BIMDC/bench.bin received/bench.bin; then
+      secs=0
+    fi
+    echo "$M $secs" >> "$CHUNK_FILE"
+    rate=$(awk -v s="$secs" 'BEGIN{ if (s > 0) printf "%.0f", 32000000 / s; else print "FAILED" }')
+    printf "%-10s %10s %14s\n" "$M" "$secs" "$rate"
+  done
+  rm -f BIMDC/bench.bin received/bench.bin
+  echo -e "\nResults saved to: $CHUNK_FILE"
+  exit 0
+fi
+
 echo -e "\n${YELLOW}Running benchmark on all CSV files in BIMDC…${NC}\n"
 
 SUCCESS_COUNT=0
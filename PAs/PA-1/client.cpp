@@ -11,15 +11,303 @@
 	Date: 09/25/2025
 */
 #include "common.h"
+#include "RequestChannel.h"
 #include "FIFORequestChannel.h"
+#include "BoundedBuffer.h"
+#include "HistogramCollection.h"
+#include "FileTransfer.h"
+#include "Export.h"
+#include "Rendezvous.h"
+#include "DataClient.h"
+#include "AsyncChannels.h"
+#include "ChunkCodec.h"
+#include "TransferManifest.h"
+#include "CorePlacement.h"
 #include <fstream> 
 #include <iostream> 
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <climits>
 #include <sys/wait.h>
+#include <getopt.h>
 
 using namespace std;
 
 
+/* asks the server for a new channel over the control channel and connects to it; returns
+NULL if the server has no channel left for us (its -L limit) */
+RequestChannel* open_new_channel (RequestChannel* control, char ipc_type) {
+	MESSAGE_TYPE nc = NEWCHANNEL_MSG;
+	control->cwrite(&nc, sizeof(MESSAGE_TYPE));
+	char namebuf[64] = {0};                  // size just needs to cover the server's name
+	control->cread(namebuf, sizeof(namebuf));   // read the c-string
+	if (namebuf[0] == 0) {
+		cerr << "The server refused a new channel" << endl;
+		return NULL;
+	}
+	return create_channel(ipc_type, namebuf, RequestChannel::CLIENT_SIDE);
+}
+
+/* opens up to n new channels, fewer if the server refuses more, and adds them to channels
+for closing at the end; falls back to the control channel if there is none at all */
+vector<RequestChannel*> open_worker_channels (RequestChannel* control, char ipc_type, int n, vector<RequestChannel*>& channels) {
+	vector<RequestChannel*> wchans;
+	for (int i = 0; i < n; i++) {
+		RequestChannel* wc = open_new_channel(control, ipc_type);
+		if (!wc) {
+			break;
+		}
+		wchans.push_back(wc);
+		channels.push_back(wc);
+	}
+	if (wchans.empty()) {
+		wchans.push_back(control);
+	}
+	return wchans;
+}
+
+/* fetches up to count consecutive points of one ECG with a single DATA_RANGE_MSG and
+returns how many arrived; the server returns fewer at the end of the recording */
+int read_range (RequestChannel* chan, int person, double seconds, int ecgno, int count, double* out) {
+	send_range_request(chan, person, lround(seconds / 0.004), ecgno, count);
+	return max(read_range_reply(chan, count, out), 0);
+}
+
+// a reply of a data worker, binned by the histogram threads
+struct data_point {
+	int person;
+	double value;
+};
+
+// produces the ECG 1 requests of one patient, n consecutive samples from time 0
+void patient_thread_function (int person, int n, BoundedBuffer* request_buffer) {
+	for (int i = 0; i < n; i++) {
+		datamsg d(person, i * 0.004, 1);
+		request_buffer->push((char*) &d, sizeof(datamsg));
+	}
+}
+
+// answers every request of the request buffer through the data client until it pops a QUIT_MSG
+void data_worker (DataClient* data_client, BoundedBuffer* request_buffer, BoundedBuffer* response_buffer) {
+	char req[MAX_MESSAGE];
+	while (true) {
+		request_buffer->pop(req, sizeof(req));
+		MESSAGE_TYPE m;
+		memcpy(&m, req, sizeof(MESSAGE_TYPE));
+		if (m == QUIT_MSG) {
+			break;
+		}
+		datamsg d(0, 0, 0);
+		memcpy(&d, req, sizeof(datamsg));
+		data_point pt = {d.person, data_client->get(d.person, d.seconds, d.ecgno)};
+		response_buffer->push((char*) &pt, sizeof(data_point));
+	}
+}
+
+// bins replies until it pops a data point for person -1
+void histogram_thread_function (BoundedBuffer* response_buffer, HistogramCollection* hc) {
+	while (true) {
+		data_point pt;
+		response_buffer->pop((char*) &pt, sizeof(data_point));
+		if (pt.person < 0) {
+			break;
+		}
+		hc->update(pt.person, pt.value);
+	}
+}
+
+/* One worker of a parallel file transfer. Chunks are claimed from a shared counter so fast
+ channels take more of them, and up to depth requests are kept in flight on the channel so
+ the server never waits for the next request. A transport that holds only max_queued
+ messages gets no more than that, or the client could block writing a request while the
+ server blocks writing a reply. Replies arrive in request order and are written straight
+ to their offset in the output file. With a manifest (-r) only its chunks are fetched, and
+ only those that match their checksum are written. */
+void file_worker (RequestChannel* chan, string filename, int outfd, __int64_t filesize, int m, int depth, bool compressed, TransferManifest* manifest, atomic<__int64_t>* next_chunk) {
+	if (chan->max_queued() > 0) {
+		depth = min(depth, chan->max_queued());
+	}
+	FileRequestEncoder enc(filename, compressed);
+	char* reply = new char[m];
+	vector<char> packed(compressed ? pack_bound(m) : 0);
+
+	// requests in flight, a ring of depth slots so the loop itself never allocates
+	vector<__int64_t> offsets(depth);
+	vector<int> lengths(depth);
+	int head = 0, inflight = 0;
+
+	__int64_t nchunks = manifest ? manifest->chunks().size() : (filesize + m - 1) / m;
+	bool more = true;
+	while (more || inflight > 0) {
+		while (more && inflight < depth) {
+			__int64_t chunk = (*next_chunk)++;
+			if (chunk >= nchunks) {
+				more = false;
+				break;
+			}
+			__int64_t offset = (manifest ? manifest->chunks()[chunk] : chunk) * m;
+			int length = (int) min((__int64_t) m, filesize - offset);
+			enc.send(chan, offset, length);
+			int slot = (head + inflight++) % depth;
+			offsets[slot] = offset;
+			lengths[slot] = length;
+		}
+		if (inflight == 0) {
+			break;
+		}
+
+		__int64_t offset = offsets[head];
+		int length = lengths[head];
+		head = (head + 1) % depth;
+		inflight--;
+		if (receive_chunk(chan, compressed, reply, length, packed.data()) != length) {
+			cerr << "Transfer of " << filename << " failed at offset " << offset << endl;
+			break;
+		}
+		if (manifest && !manifest->verify(offset, reply, length)) {
+			continue;  // left out of the manifest, the next run fetches it again
+		}
+		if (pwrite(outfd, reply, length, offset) != length) {
+			EXITONERROR("received/" + filename);
+		}
+		if (manifest) {
+			manifest->complete(offset, length);
+		}
+	}
+	delete[] reply;
+}
+
+/* The -n data mode with -a: a single thread keeps depth DATA_MSG requests in flight on
+ each of the channels and bins the replies as they complete. Slot s of the requests in
+ flight always goes to channel s % channels, so no channel gets more than depth. */
+void async_data_requests (const vector<RequestChannel*>& wchans, int npatients, int n, int depth, HistogramCollection* hc) {
+	AsyncChannels async(wchans, AsyncChannels::AUTO, depth);
+	int nslots = wchans.size() * depth;
+	vector<datamsg> requests(nslots, datamsg(0, 0, 0));
+	vector<double> replies(nslots);
+	vector<AsyncChannels::Completion> done(nslots);
+	vector<int> free_slots;
+	for (int s = nslots; s-- > 0; ) {
+		free_slots.push_back(s);
+	}
+
+	long next = 0, total = (long) npatients * n;
+	while (next < total || async.pending() > 0) {
+		while (next < total && !free_slots.empty()) {
+			int s = free_slots.back();
+			free_slots.pop_back();
+			requests[s] = datamsg(next / n + 1, (next % n) * 0.004, 1);
+			async.submit(s % wchans.size(), &requests[s], sizeof(datamsg), &replies[s], sizeof(double), s);
+			next++;
+		}
+		int k = async.wait(done.data(), done.size());
+		for (int i = 0; i < k; i++) {
+			int s = done[i].tag;
+			if (done[i].result == (int) sizeof(double)) {
+				hc->update(requests[s].person, replies[s]);
+			}
+			free_slots.push_back(s);
+		}
+	}
+	cout << "Async " << async.backend() << ": " << nslots << " requests in flight on " << wchans.size() << " channels" << endl;
+}
+
+/* The parallel file transfer with -a: a single thread keeps depth chunk requests in
+ flight on each of the channels and writes every reply to its offset as it completes
+ (unpacked first with -z, and checked against the manifest with -r). */
+void async_file_transfer (const vector<RequestChannel*>& wchans, string filename, int outfd, __int64_t filesize, int m, int depth, bool compressed, TransferManifest* manifest) {
+	AsyncChannels async(wchans, AsyncChannels::AUTO, depth);
+	int nslots = wchans.size() * depth;
+	int reqlen = sizeof(filemsg) + filename.size() + 1;
+	int replylen = compressed ? sizeof(int) + pack_bound(m) : m;
+	vector<char> requests((size_t) nslots * reqlen);
+	vector<char> replies((size_t) nslots * replylen);
+	vector<char> unpacked(compressed ? m : 0);
+	vector<__int64_t> offsets(nslots);
+	vector<int> lengths(nslots);
+	vector<AsyncChannels::Completion> done(nslots);
+	vector<int> free_slots;
+	for (int s = nslots; s-- > 0; ) {
+		char* req = &requests[(size_t) s * reqlen];
+		memcpy(req + sizeof(filemsg), filename.c_str(), filename.size() + 1);
+		free_slots.push_back(s);
+	}
+
+	__int64_t next = 0, nchunks = manifest ? manifest->chunks().size() : (filesize + m - 1) / m;
+	bool failed = false;
+	while ((next < nchunks && !failed) || async.pending() > 0) {
+		while (next < nchunks && !failed && !free_slots.empty()) {
+			int s = free_slots.back();
+			free_slots.pop_back();
+			__int64_t offset = (manifest ? manifest->chunks()[next] : next) * m;
+			filemsg f(offset, (int) min((__int64_t) m, filesize - offset));
+			f.mtype = compressed ? FILEZ_MSG : FILE_MSG;
+			memcpy(&requests[(size_t) s * reqlen], &f, sizeof(filemsg));
+			offsets[s] = offset;
+			lengths[s] = f.length;
+			async.submit(s % wchans.size(), &requests[(size_t) s * reqlen], reqlen, &replies[(size_t) s * replylen], replylen, s);
+			next++;
+		}
+		int k = async.wait(done.data(), done.size());
+		for (int i = 0; i < k; i++) {
+			int s = done[i].tag;
+			int length = lengths[s];
+			char* chunk = &replies[(size_t) s * replylen];
+			if (compressed && done[i].result > 0) {
+				bool ok = unpack_reply(chunk, done[i].result, unpacked.data(), length) == length;
+				chunk = unpacked.data();
+				done[i].result = ok ? length : -1;
+			}
+			if (done[i].result != length) {
+				if (!failed) {
+					cerr << "Transfer of " << filename << " failed at offset " << offsets[s] << endl;
+				}
+				failed = true;
+			}
+			else if (!manifest || manifest->verify(offsets[s], chunk, length)) {
+				if (pwrite(outfd, chunk, length, offsets[s]) != length) {
+					EXITONERROR("received/" + filename);
+				}
+				if (manifest) {
+					manifest->complete(offsets[s], length);
+				}
+			}
+			free_slots.push_back(s);
+		}
+	}
+}
+
+/* -r: picks up the manifest of an earlier run of this transfer and gets the checksums of
+ the chunks still to fetch; returns NULL if the server cannot provide them */
+TransferManifest* open_manifest (RequestChannel* chan, const string& filename, __int64_t filesize, int m) {
+	TransferManifest* manifest = new TransferManifest("received/" + filename, filesize, m);
+	if (manifest->resuming()) {
+		cout << "Resuming " << filename << ": " << manifest->chunks().size() << " of "
+			 << (filesize + m - 1) / m << " chunks left" << endl;
+	}
+	if (!manifest->fetch_checksums(chan, filename)) {
+		delete manifest;
+		return NULL;
+	}
+	return manifest;
+}
+
+// reports how a transfer with -r ended, and removes its manifest if nothing is missing
+void finish_manifest (TransferManifest* manifest, const string& filename) {
+	__int64_t fetched = manifest->chunks().size();
+	if (manifest->finish()) {
+		cout << "Verified all " << fetched << " chunks fetched of " << filename << endl;
+	}
+	else {
+		cerr << manifest->missing() << " of " << fetched << " chunks of " << filename << " are missing or damaged ("
+			 << manifest->failures() << " failed their checksum), run again with -r to fetch them" << endl;
+	}
+}
+
+
 int main (int argc, char *argv[]) {
 	int opt;
 	int p = -1;
@@ -27,9 +315,38 @@ int main (int argc, char *argv[]) {
 	int e = -1;
 	int m1 = MAX_MESSAGE;
 	bool new_chan_request = false;
+	int nworkers = 0;    // > 0 transfers files over this many channels in parallel
+	int depth = 4;       // requests in flight per channel in the parallel transfer
+	int n = 0;           // > 0 runs the threaded data mode with n samples per patient
+	int h = 1;           // histogram threads in the threaded data mode
+	int b = 100;         // capacity (in messages) of its request and response buffers
+	string server_workers = ""; // passed on as the server's -e (event-driven mode)
+	bool print_stats = false;   // print the server's statistics before quitting
+	string pipe_size = "";      // FIFO capacity in bytes for both sides, see set_pipe_size
+	string delay_model = "";    // passed on as the server's -D (simulated lookup latency)
+	string cache_mb = "";       // passed on as the server's -k (chunk cache size in MiB)
+	string max_channels = "";   // passed on as the server's -L (most channels open at once)
+	string idle_seconds = "";   // passed on as the server's -I (idle channel timeout)
+	string server_cpus = "";    // passed on as the server's -A (CPUs of its threads)
+	bool sidecars = false;      // -S: passed on as the server's -c (cached parsed BIMDC files)
+	string export_patients = "";  // -x: patients to export, from -t on for -l seconds
+	double export_duration = -1;  // < 0 exports up to the end of the recording
+	bool export_binary = false;   // -B: binary export files instead of CSV
+	double summary_bucket = -1;   // -g: summaries of -p from -t on for -l seconds, per bucket of this many seconds
+	bool compressed = false;     // -z: chunks come packed as FILEZ_MSG replies, see ChunkCodec
+	bool async_io = false;       // -a: one thread drives all -w channels, see AsyncChannels
+	bool resume = false;         // -r: checked chunks, resumed from received/<file>.manifest
+	size_t cache_points = 65536; // -K: points in the data client's LRU cache, 0 turns it off
+	bool m_given = false;
+	string connect_path = "";     // --connect[=path]: use a running daemon instead of forking one
+	char ipc_type = 'f'; // transport used for every channel, see create_channel
 	
 	string filename = "";
-	while ((opt = getopt(argc, argv, "p:t:e:f:m:c")) != -1) {
+	const struct option long_options[] = {
+		{"connect", optional_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0}
+	};
+	while ((opt = getopt_long(argc, argv, "p:t:e:f:m:ci:w:d:n:h:b:E:sP:D:k:K:L:I:x:l:Bazrg:A:S", long_options, NULL)) != -1) {
 		switch (opt) {
 			case 'p':
 				p = atoi (optarg);
@@ -45,73 +362,348 @@ int main (int argc, char *argv[]) {
 				break;
 			case 'm':
 				m1 = atoi (optarg);
+				m_given = true;
 				break;
 			case 'c':
 				new_chan_request = true;
 				break;
+			case 'i':
+				ipc_type = optarg[0];
+				break;
+			case 'w':
+				nworkers = atoi (optarg);
+				break;
+			case 'd':
+				depth = max(1, atoi (optarg));
+				break;
+			case 'n':
+				n = atoi (optarg);
+				break;
+			case 'h':
+				h = max(1, atoi (optarg));
+				break;
+			case 'b':
+				b = atoi (optarg);
+				break;
+			case 'E':
+				server_workers = optarg;
+				break;
+			case 's':
+				print_stats = true;
+				break;
+			case 'P':
+				pipe_size = optarg;
+				FIFORequestChannel::set_pipe_size(atoi(optarg));
+				break;
+			case 'D':
+				delay_model = optarg;
+				break;
+			case 'k':
+				cache_mb = optarg;
+				break;
+			case 'K':
+				cache_points = max(0, atoi (optarg));
+				break;
+			case 'L':
+				max_channels = optarg;
+				break;
+			case 'I':
+				idle_seconds = optarg;
+				break;
+			case 'x':
+				export_patients = optarg;
+				break;
+			case 'l':
+				export_duration = atof (optarg);
+				break;
+			case 'B':
+				export_binary = true;
+				break;
+			case 'a':
+				async_io = true;
+				break;
+			case 'z':
+				compressed = true;
+				break;
+			case 'r':
+				resume = true;
+				break;
+			case 'g':
+				summary_bucket = max(0.0, atof (optarg));
+				break;
+			case 'A':
+				server_cpus = optarg;
+				break;
+			case 'S':
+				sidecars = true;
+				break;
+			case 'C':
+				connect_path = optarg ? optarg : RENDEZVOUS_PATH;
+				break;
 
 		}
 	}
 
+	if (!valid_ipc_type(ipc_type)) {
+		cerr << "Unknown IPC type " << ipc_type << ", use " << IPC_TYPE_USAGE << endl;
+		return 1;
+	}
+	if (!server_workers.empty() && ipc_type == 's') {
+		// the server would refuse to start and leave us waiting for the control channel
+		cerr << "The server's event-driven mode (-E) does not support shared memory channels" << endl;
+		return 1;
+	}
+	string delay_name = delay_model.substr(0, delay_model.find(':'));
+	if (!delay_model.empty() && delay_name != "none" && delay_name != "fixed" && delay_name != "uniform" && delay_name != "exp") {
+		// the same goes for a -D the server cannot parse
+		cerr << "Unknown delay model " << delay_model << ", use none, fixed[:us], uniform[:us] or exp[:us]" << endl;
+		return 1;
+	}
+	CorePlacement cpu_check;
+	if (!server_cpus.empty() && !cpu_check.configure(server_cpus)) {
+		return 1;  // and a CPU list it would refuse
+	}
 	
-	std::vector<FIFORequestChannel*> channels;
-	int pid = fork();
+	vector<int> export_persons;
+	if (!export_patients.empty()) {
+		if (!parse_patients(export_patients, export_persons)) {
+			cerr << "Cannot parse the patients " << export_patients << ", use all or a list like 1,4-6" << endl;
+			return 1;
+		}
+		if (!m_given) {
+			m1 = 65536;  // a DATA_RANGE_MSG of 8191 points instead of 31 per round trip
+		}
+	}
+	if (summary_bucket >= 0 && !m_given) {
+		m1 = 65536;  // 2730 summaries per AGGREGATE_MSG instead of 10
+	}
+
+	std::vector<RequestChannel*> channels;
+	int pid = -1;
+	string control_name = "control";
+	if (!connect_path.empty()) {
+		/* the daemon decides the transport and the buffer capacity, and its own flags (-E,
+		-D, -k, -L, -I, -A) were given when it was started */
+		int capacity = 0;
+		if (!rendezvous_connect(connect_path, ipc_type, control_name, capacity)) {
+			return 1;
+		}
+		if (!m_given || m1 > capacity) {
+			m1 = capacity;
+		}
+	}
+	else {
+		pid = fork();
+	}
 
 	if (pid == 0) {
 		//child process - run server
 		//pass m to server
 		std::string m_str = std::to_string(m1);
-		execl("./server", "server", "-m", m_str.c_str(), (char*)nullptr);
+		std::string i_str(1, ipc_type);
+		std::vector<const char*> args = {"server", "-m", m_str.c_str(), "-i", i_str.c_str()};
+		if (!server_workers.empty()) {
+			args.push_back("-e");
+			args.push_back(server_workers.c_str());
+		}
+		if (!pipe_size.empty()) {
+			args.push_back("-P");
+			args.push_back(pipe_size.c_str());
+		}
+		if (!delay_model.empty()) {
+			args.push_back("-D");
+			args.push_back(delay_model.c_str());
+		}
+		if (!cache_mb.empty()) {
+			args.push_back("-k");
+			args.push_back(cache_mb.c_str());
+		}
+		if (!max_channels.empty()) {
+			args.push_back("-L");
+			args.push_back(max_channels.c_str());
+		}
+		if (!idle_seconds.empty()) {
+			args.push_back("-I");
+			args.push_back(idle_seconds.c_str());
+		}
+		if (!server_cpus.empty()) {
+			args.push_back("-A");
+			args.push_back(server_cpus.c_str());
+		}
+		if (sidecars) {
+			args.push_back("-c");
+		}
+		args.push_back(nullptr);
+		execv("./server", (char* const*) args.data());
 		perror("exec failed");
     	_exit(127);
 
 	}
 
-	if (pid > 0) {
+	if (pid > 0 || !connect_path.empty()) {
 		//parent process - run client
-		FIFORequestChannel chan1("control", FIFORequestChannel::CLIENT_SIDE);
-		channels.push_back(&chan1);
+		RequestChannel* chan1 = create_channel(ipc_type, control_name, RequestChannel::CLIENT_SIDE);
+		channels.push_back(chan1);
 
 		if(new_chan_request) {
-			MESSAGE_TYPE nc = NEWCHANNEL_MSG;
-			chan1.cwrite(&nc, sizeof(MESSAGE_TYPE));
-			char namebuf[64] = {0};                  // size just needs to cover the server's name
-			chan1.cread(namebuf, sizeof(namebuf));   // read the c-string
-			std::string ncName(namebuf);
-			FIFORequestChannel* p = new FIFORequestChannel(ncName.c_str(), FIFORequestChannel::CLIENT_SIDE);
-			channels.push_back(p);
+			RequestChannel* nc = open_new_channel(chan1, ipc_type);
+			if (nc) {
+				channels.push_back(nc);
+			}
 		}
 		
-		FIFORequestChannel* chan = channels.back();
-		if(p != -1 && e != -1 && t != -1.0) {
-			datamsg push(p, t, e);
-			char buf[MAX_MESSAGE];
-			memcpy(buf, &push, sizeof(datamsg));
-			chan->cwrite(buf, sizeof(datamsg));
-
-			double reply = 0.0;
-			chan->cread(&reply, sizeof(double));
+		RequestChannel* chan = channels.back();
+		unique_ptr<DataClient> data_client;  // data queries, reported with -s
+		if(!export_persons.empty()) {
+			/* streaming export: the patients are shared among -w channels (one by default),
+			each exporting one patient at a time with -d batches in flight */
+			ExportOptions opt = {max(t, 0.0), export_duration, export_binary, datarange_capacity(m1), depth};
+			if (opt.batch <= 0) {
+				cerr << "A buffer of " << m1 << " bytes cannot hold a DATA_RANGE_MSG reply" << endl;
+			}
+			int nw = min((int) export_persons.size(), max(nworkers, 1));
+			vector<RequestChannel*> wchans = opt.batch > 0 ? open_worker_channels(chan1, ipc_type, nw, channels) : vector<RequestChannel*>();
+			auto start = chrono::steady_clock::now();
+			atomic<size_t> next_person(0);
+			atomic<__int64_t> total(0);
+			vector<thread> exporters;
+			for (RequestChannel* wc : wchans) {
+				exporters.push_back(thread([&, wc] {
+					size_t i;
+					while ((i = next_person++) < export_persons.size()) {
+						__int64_t samples = export_patient(wc, export_persons[i], opt);
+						if (samples < 0) {
+							break;  // the channel is out of step with its replies now
+						}
+						total += samples;
+					}
+				}));
+			}
+			for (thread& th : exporters) {
+				th.join();
+			}
+			chrono::duration<double> took = chrono::steady_clock::now() - start;
+			cout << "Exported " << total << " samples of " << export_persons.size() << " patients in "
+				 << took.count() << " seconds" << endl;
+		}
+		else if(n > 0) {
+			/* threaded data mode: -p patients (1 through p, all of them by default) each get a
+			producer thread, -w workers each own a channel, -h threads fill the histograms */
+			int npatients = (p == -1) ? NUM_PERSONS : min(p, NUM_PERSONS);
+			BoundedBuffer request_buffer(b);
+			BoundedBuffer response_buffer(b);
+			HistogramCollection hc;
+			for (int i = 0; i < npatients; i++) {
+				hc.add(new Histogram(12, -2.0, 2.0));
+			}
+
+			vector<RequestChannel*> wchans = open_worker_channels(chan1, ipc_type, max(nworkers, 1), channels);
+			int nw = wchans.size();
+			auto start = chrono::steady_clock::now();
+			if (async_io) {
+				async_data_requests(wchans, npatients, n, depth, &hc);
+			}
+			else {
+				data_client.reset(new DataClient(wchans, cache_points));
+				vector<thread> patients, workers, histograms;
+				for (int i = 0; i < npatients; i++) {
+					patients.push_back(thread(patient_thread_function, i+1, n, &request_buffer));
+				}
+				for (int i = 0; i < nw; i++) {
+					workers.push_back(thread(data_worker, data_client.get(), &request_buffer, &response_buffer));
+				}
+				for (int i = 0; i < h; i++) {
+					histograms.push_back(thread(histogram_thread_function, &response_buffer, &hc));
+				}
+
+				// shut the stages down in order, each one after its producers are done
+				for (thread& th : patients) {
+					th.join();
+				}
+				for (int i = 0; i < nw; i++) {
+					MESSAGE_TYPE q = QUIT_MSG;
+					request_buffer.push((char*) &q, sizeof(MESSAGE_TYPE));
+				}
+				for (thread& th : workers) {
+					th.join();
+				}
+				for (int i = 0; i < h; i++) {
+					data_point done = {-1, 0.0};
+					response_buffer.push((char*) &done, sizeof(data_point));
+				}
+				for (thread& th : histograms) {
+					th.join();
+				}
+			}
+			chrono::duration<double> took = chrono::steady_clock::now() - start;
+
+			hc.print();
+			cout << "Took " << took.count() << " seconds" << endl;
+		}
+		else if(p != -1 && summary_bucket >= 0) {
+			/* "time,min,max,mean" of ECG e (1 by default) of patient p from -t on for -l seconds
+			(the rest of the recording by default), one line per bucket of -g seconds or a
+			single line for -g 0; the server computes them, so no point crosses the channel */
+			int capacity = aggregate_capacity(m1);
+			vector<ecg_summary> summaries(capacity);
+			long sample = lround(max(t, 0.0) / 0.004);
+			long left = export_duration < 0 ? INT_MAX : lround(export_duration / 0.004);
+			int bucket = summary_bucket > 0 ? max(1L, lround(summary_bucket / 0.004)) : 0;
+			int ecgno = (e == 2) ? 2 : 1;
+			cout << "time,min,max,mean" << endl;
+			while (left > 0 && capacity > 0) {
+				int covered = 0;
+				int want = (int) min(left, (long) INT_MAX);
+				int got = request_summaries(chan, p, sample, ecgno, want, bucket, capacity, summaries.data(), covered);
+				if (got <= 0 || covered <= 0) {
+					break;  // the end of the recording, or a broken reply
+				}
+				for (int i = 0; i < got; i++) {
+					cout << (sample + (long) i * bucket) * 0.004 << ',' << summaries[i].min << ','
+						 << summaries[i].max << ',' << summaries[i].mean << '\n';
+				}
+				sample += covered;
+				left -= covered;
+				if (covered < want && (bucket == 0 || got < capacity)) {
+					break;  // the recording ended within this window
+				}
+			}
+			cout.flush();
+		}
+		else if(p != -1 && e != -1 && t != -1.0) {
+			data_client.reset(new DataClient({chan}, cache_points));
+			double reply = data_client->get(p, t, e);
 			cout << "For person " << p << ", at time " << t << ", the value of ecg " << e << " is " << reply << endl;
+		}else if(p != -1 && datarange_capacity(m1) > 0) {
+			// the first 1000 points of both ECGs in batches, one DATA_RANGE_MSG per batch
+			const int npoints = 1000;
+			int batch = datarange_capacity(m1);
+			vector<double> ecg1(npoints), ecg2(npoints);
+			for(int i = 0; i < npoints; ) {
+				int want = min(batch, npoints - i);
+				if(read_range(chan, p, i * 0.004, 1, want, &ecg1[i]) != want ||
+				   read_range(chan, p, i * 0.004, 2, want, &ecg2[i]) != want) {
+					cerr << "Could not fetch the data of person " << p << endl;
+					break;
+				}
+				i += want;
+			}
+
+			double time = 0.0;
+			ofstream outputFile("received/x1.csv");
+			for(int i = 0; i < npoints; i++) {
+				outputFile << time << ',' << ecg1[i] << ',' << ecg2[i] << endl;
+				time += 0.004;
+			}
+			outputFile.close();
 		}else if(p != -1) {
+			// buffer too small for a batch, one round trip per point for both ECGs
+			data_client.reset(new DataClient({chan}, cache_points));
 			double time = 0.0;
 			ofstream outputFile("received/x1.csv");
 			for(int i = 0; i < 1000; i++) {
-				datamsg push1(p, time, 1);
-				char buf[MAX_MESSAGE];
-				memcpy(buf, &push1, sizeof(datamsg));
-				chan->cwrite(buf, sizeof(datamsg));
-
-				double reply1 = 0.0;
-				chan->cread(&reply1, sizeof(double));
-
-				datamsg push2(p, time, 2);
-				// char buf[MAX_MESSAGE];
-				memcpy(buf, &push2, sizeof(datamsg));
-				chan->cwrite(buf, sizeof(datamsg));
-
-				double reply2 = 0.0;
-				chan->cread(&reply2, sizeof(double));
-
+				double reply1 = data_client->get(p, time, 1);
+				double reply2 = data_client->get(p, time, 2);
 				outputFile << time << ',' << reply1 << ',' << reply2 << endl;
 				time += 0.004;
 			}
@@ -119,60 +711,91 @@ int main (int argc, char *argv[]) {
 		}
 
 		if(!filename.empty()){
-			filemsg fm(0, 0);
-			int len = sizeof(filemsg) + (filename.size() + 1);
-			char* buf3 = new char[len];
-
-			memcpy(buf3, &fm, sizeof(filemsg));
-			strcpy(buf3 + sizeof(filemsg), filename.c_str());
-			chan->cwrite(buf3, len);
-
-			__int64_t filesize = 0;
-			chan->cread(&filesize, sizeof(__int64_t));
-
-			ofstream outputFile("received/"+filename, ios::binary);
-
-			char* buf4 = new char[m1]; //read
-			char* buf5 = new char[len]; //write
-			__int64_t offset = 0;
+			FileRequestEncoder enc(filename, compressed);
+			__int64_t filesize = request_file_size(chan, enc);
+			unique_ptr<TransferManifest> manifest(resume ? open_manifest(chan, filename, filesize, m1) : NULL);
+			int keep = (manifest && manifest->resuming()) ? 0 : O_TRUNC;  // -r keeps what earlier runs wrote
 
-			while(offset < filesize - m1) {
-				filemsg fn(offset, m1);
-				memcpy(buf5, &fn, sizeof(filemsg));
-				strcpy(buf5 + sizeof(filemsg), filename.c_str());
-				chan->cwrite(buf5, len);
-
-				chan->cread(buf4, m1);
-				outputFile.write(buf4, m1);
-				offset+=m1;
+			if (resume && !manifest) {
+				cerr << "Transfer of " << filename << " skipped, its chunks cannot be checked" << endl;
 			}
+			else if (nworkers > 0) {
+				int outfd = open(("received/" + filename).c_str(), O_WRONLY | O_CREAT | keep, 0644);
+				if (outfd < 0 || ftruncate(outfd, filesize) < 0) {
+					EXITONERROR("received/" + filename);
+				}
 
-			__int64_t lastChunk = filesize - offset;
-			filemsg fn(offset, lastChunk);
-			memcpy(buf5, &fn, sizeof(filemsg));
-			strcpy(buf5 + sizeof(filemsg), filename.c_str());
-			chan->cwrite(buf5, len);
+				vector<RequestChannel*> wchans = open_worker_channels(chan1, ipc_type, nworkers, channels);
+				if (async_io) {
+					async_file_transfer(wchans, filename, outfd, filesize, m1, depth, compressed, manifest.get());
+				}
+				else {
+					atomic<__int64_t> next_chunk(0);
+					vector<thread> workers;
+					for (size_t i = 0; i < wchans.size(); i++) {
+						workers.push_back(thread(file_worker, wchans[i], filename, outfd, filesize, m1, depth, compressed, manifest.get(), &next_chunk));
+					}
+					for (thread& w : workers) {
+						w.join();
+					}
+				}
+				close(outfd);
+			}
+			else {
+				// the request and the reply buffer are set up once, the chunk loop does not allocate
+				int outfd = open(("received/" + filename).c_str(), O_WRONLY | O_CREAT | keep, 0644);
+				if (outfd < 0) {
+					EXITONERROR("received/" + filename);
+				}
+				vector<char> buf(m1);
+				vector<char> packed(compressed ? pack_bound(m1) : 0);
+				bool ok = true;
+				if (!manifest) {
+					ok = transfer_chunks(chan, enc, 0, filesize, m1, buf.data(), outfd, packed.data());
+				}
+				else {
+					// one run of transfer_chunks per stretch of consecutive chunks still to fetch
+					const vector<__int64_t>& todo = manifest->chunks();
+					for (size_t i = 0, j; ok && i < todo.size(); i = j) {
+						for (j = i + 1; j < todo.size() && todo[j] == todo[j - 1] + 1; j++);
+						ok = transfer_chunks(chan, enc, todo[i] * m1, min(todo[j - 1] * m1 + m1, filesize), m1, buf.data(), outfd, packed.data(), manifest.get());
+					}
+				}
+				if (!ok) {
+					cerr << "Transfer of " << filename << " failed" << endl;
+				}
+				close(outfd);
+			}
+			if (manifest) {
+				finish_manifest(manifest.get(), filename);
+			}
+		}
 
-			chan->cread(buf4, lastChunk);
-			outputFile.write(buf4, lastChunk);
-			outputFile.close();
-			delete[] buf5;
-			delete[] buf4;
-			delete[] buf3;
+		if(print_stats) {
+			MESSAGE_TYPE sm = STATS_MSG;
+			chan1->cwrite(&sm, sizeof(MESSAGE_TYPE));
+			__int64_t len = 0;
+			chan1->cread(&len, sizeof(__int64_t));
+			vector<char> text(len + 1, 0);
+			chan1->cread_full(text.data(), len);
+			cout << text.data();
+			if (data_client) {
+				cout << data_client->report();
+			}
 		}
 
-		// closing the channels
-		for(long unsigned int i = 0; i < channels.size(); i++) {    
+		// closing the channels, control last so the server outlives the data channels
+		for(long unsigned int i = channels.size(); i-- > 0; ) {    
 			MESSAGE_TYPE m = QUIT_MSG;
-			FIFORequestChannel* chan = channels[i];
+			RequestChannel* chan = channels[i];
 			chan->cwrite(&m, sizeof(MESSAGE_TYPE));
-			if(i != 0){
-				delete chan;
-			}
+			delete chan;
 		}
 
-		int status = 0;
-		waitpid(pid, &status, 0);
+		if (pid > 0) {
+			int status = 0;
+			waitpid(pid, &status, 0);
+		}
 		return 0;
 	}
 
@@ -1,5 +1,8 @@
 #include "common.h"
 
+#include <algorithm>
+#include <cstdint>
+
 using namespace std;
 
 
@@ -34,3 +37,20 @@ __int64_t get_file_size (string filename) {
     return size;
 }
 
+// most data points of one DATA_RANGE_MSG reply of at most buffercapacity bytes: the int
+// count followed directly by the points, sent as two iovecs with no padding between them
+int datarange_capacity (int buffercapacity) {
+	return max(0, (buffercapacity - (int) sizeof(int)) / (int) sizeof(double));
+}
+
+// most chunk checksums of one FILESUM_MSG reply for chunks of chunksize bytes, laid out like
+// a DATA_RANGE_MSG reply so that it fits into a buffer of one chunk
+int filesum_capacity (int chunksize) {
+	return max(0, (chunksize - (int) sizeof(uint64_t)) / (int) sizeof(uint64_t));
+}
+
+// most summaries of one AGGREGATE_MSG reply built in a buffer of buffercapacity bytes, behind
+// its two ints
+int aggregate_capacity (int buffercapacity) {
+	return max(0, (buffercapacity - 2 * (int) sizeof(int)) / (int) sizeof(ecg_summary));
+}
@@ -23,7 +23,9 @@ typedef char byte_t;
 
 
 // different types of messages
-enum MESSAGE_TYPE {UNKNOWN_MSG, DATA_MSG, FILE_MSG, NEWCHANNEL_MSG, QUIT_MSG};
+enum MESSAGE_TYPE {UNKNOWN_MSG, DATA_MSG, FILE_MSG, NEWCHANNEL_MSG, QUIT_MSG, DATA_RANGE_MSG, STATS_MSG, DATA_PAIR_MSG, FILEZ_MSG, FILESUM_MSG, AGGREGATE_MSG};
+// STATS_MSG is just the type; the reply is an __int64_t length and then, as a second
+// message, that many bytes of text with the server's statistics
 
 
 // message requesting a data point
@@ -43,7 +45,85 @@ public:
 };
 
 
+// message requesting both ECGs at one time in a single round trip
+// reply: two doubles, the value of ECG 1 and then the value of ECG 2
+class datapairmsg {
+public:
+    MESSAGE_TYPE mtype;
+    int person;
+    double seconds;
+
+    datapairmsg (int _person, double _seconds) {
+        mtype = DATA_PAIR_MSG;
+        person = _person;
+        seconds = _seconds;
+    }
+};
+
+
+// message requesting count consecutive data points of one ECG, starting at seconds
+// reply: an int n followed by n doubles, where n is capped by datarange_capacity of the
+// server's buffer capacity and by the end of the recording
+class datarangemsg {
+public:
+    MESSAGE_TYPE mtype;
+    int person;
+    double seconds;
+    int ecgno;
+    int count;
+
+    datarangemsg (int _person, double _seconds, int _eno, int _count) {
+        mtype = DATA_RANGE_MSG;
+        person = _person;
+        seconds = _seconds;
+        ecgno = _eno;
+        count = _count;
+    }
+};
+
+
+// summary of a window of consecutive points of one ECG
+struct ecg_summary {
+    double min;
+    double max;
+    double mean;
+};
+
+
+// message requesting summaries of count consecutive points of one ECG, starting at seconds,
+// one per bucket of bucket points (the last one may hold fewer); a bucket of count points or
+// more, or of 0, gives a single summary of the whole window, and smaller ones a downsampled
+// series of it
+// reply: an int n, an int with the number of points the summaries cover, then n ecg_summary;
+// n is capped by aggregate_capacity of the server's buffer capacity and by the end of the
+// recording
+class aggregatemsg {
+public:
+    MESSAGE_TYPE mtype;
+    int person;
+    double seconds;
+    int ecgno;
+    int count;
+    int bucket;
+
+    aggregatemsg (int _person, double _seconds, int _eno, int _count, int _bucket) {
+        mtype = AGGREGATE_MSG;
+        person = _person;
+        seconds = _seconds;
+        ecgno = _eno;
+        count = _count;
+        bucket = _bucket;
+    }
+};
+
+
 // message requesting a file
+// FILEZ_MSG is the same request with mtype FILEZ_MSG; its reply is the int length of the
+// chunk followed by the chunk packed with pack_chunk (see ChunkCodec.h)
+// FILESUM_MSG asks for the checksums of consecutive chunks of length bytes from offset on;
+// its reply is an int n followed by n uint64_t chunk_checksum values (see Checksum.h), where
+// n is capped by filesum_capacity(length), so the reply fits into the buffer of one chunk,
+// and by the end of the file
 class filemsg {
 public:
     MESSAGE_TYPE mtype;
@@ -60,5 +140,8 @@ public:
 void EXITONERROR (std::string msg);
 std::vector<std::string> split (std::string line, char separator);
 __int64_t get_file_size (std::string filename);
+int datarange_capacity (int buffercapacity);
+int filesum_capacity (int chunksize);
+int aggregate_capacity (int buffercapacity);
 
 #endif
@@ -0,0 +1,113 @@
+#!/bin/bash
+# Behavioural checks of the client's modes beyond the ones graded by pa1-tests.sh. Every
+# check runs the client (which forks its own server) and diffs what it received against
+# the source. Exits with the number of failed checks.
+COLOUR=0
+if [[ COLOUR -eq 0 ]]; then
+    GREEN='\033[0;32m'
+    RED='\033[0;31m'
+    NC='\033[0m'
+else
+    GREEN='\033[0m'
+    RED='\033[0m'
+    NC='\033[0m'
+fi
+
+FAILED=0
+TRANSPORTS="f s u"
+if [[ "$(uname)" == "Linux" ]]; then
+	TRANSPORTS="$TRANSPORTS q"
+fi
+
+# a file of its own, so the tracked copies under received/ stay as they are
+SRC=ft_1.csv
+cp BIMDC/1.csv BIMDC/$SRC
+
+# check <name> <command...>: passes if the command succeeds within a minute
+check () {
+	local name="$1"
+	shift
+	if timeout 60 bash -c "$*" >/dev/null 2>&1; then
+		echo -e "  ${GREEN}Passed${NC} $name"
+	else
+		echo -e "  ${RED}Failed${NC} $name"
+		FAILED=$(($FAILED+1))
+	fi
+}
+
+
+echo -e "\nDeep pipelines"
+# more requests in flight than a message queue holds
+for i in $TRANSPORTS; do
+	check "-i $i -w 2 -d 64" "./client -i $i -f $SRC -w 2 -d 64 && cmp BIMDC/$SRC received/$SRC"
+done
+rm -f received/$SRC
+
+echo -e "\nEvent-driven server"
+for i in $TRANSPORTS; do
+	if [[ "$i" != "s" ]]; then  # shared memory has no descriptors to poll
+		check "-i $i -E 2" "./client -i $i -f $SRC -E 2 -w 4 && cmp BIMDC/$SRC received/$SRC"
+	fi
+done
+rm -f received/$SRC
+
+echo -e "\nExport"
+check "-x 1,3" "./client -x 1,3 && cmp BIMDC/1.csv received/export_1.csv && cmp BIMDC/3.csv received/export_3.csv"
+# the doubles after the 32-byte header, against the values of the CSV
+check "-x 2 -B" "./client -x 2 -B && od -A n -v -w16 -t f8 -j 32 received/export_2.bin | awk '{print \$1\",\"\$2}' \\
+	| paste -d, - <(cut -d, -f2,3 BIMDC/2.csv) | awk -F, '\$1 != \$3 || \$2 != \$4 { bad++ } END { exit NR != 15000 || bad }'"
+rm -f received/export_*
+
+echo -e "\nCompressed chunks"
+for i in $TRANSPORTS; do
+	check "-i $i -z" "./client -i $i -f $SRC -z -w 2 && cmp BIMDC/$SRC received/$SRC"
+done
+rm -f received/$SRC
+
+echo -e "\nResumed transfers"
+# a transfer of a file of 16 MB in chunks of 64 bytes is killed, with its server, once its
+# manifest records a first range of chunks (the checksums alone can take seconds to fetch);
+# a second run must pick up the manifest, fetch the rest and remove the manifest
+BIG=ft_big.csv
+for i in $(seq 1 4); do cat BIMDC/[0-9]*.csv; done > BIMDC/$BIG
+./client -f $BIG -m 64 -r >/dev/null 2>&1 &
+CLIENT=$!
+for (( t = 0; t < 600; t++ )); do
+	if [[ $(cat received/$BIG.manifest 2>/dev/null | wc -l) -ge 2 ]] || ! kill -0 $CLIENT 2>/dev/null; then
+		break
+	fi
+	sleep 0.1
+done
+pkill -KILL -P $CLIENT
+{ kill -KILL $CLIENT; wait $CLIENT; } 2>/dev/null
+check "-r after a kill" "test -f received/$BIG.manifest && ./client -f $BIG -m 64 -r > received/ft_resume.txt \\
+	&& grep -q Resuming received/ft_resume.txt && cmp BIMDC/$BIG received/$BIG && test ! -f received/$BIG.manifest"
+rm -f received/$BIG received/$BIG.manifest received/ft_resume.txt BIMDC/$BIG
+
+echo -e "\nSummaries"
+# summaries_match <ecg> <bucket seconds> <client options...>: the client's summaries of
+# patient 1 against min, max and mean computed here from BIMDC/1.csv (bucket 0: one for all)
+summaries_match () {
+	local ecg=$1 bucket=$2
+	shift 2
+	./client -p 1 -e $ecg -g $bucket "$@" | grep '^[0-9]' > received/ft_summary.txt || return 1
+	awk -F, -v col=$(($ecg+1)) -v n=$(($bucket*250)) '
+		{ b = n ? int((NR-1) / n) : 0; v = $col
+		  if (!(b in c) || v < lo[b]) lo[b] = v
+		  if (!(b in c) || v > hi[b]) hi[b] = v
+		  sum[b] += v; c[b]++ }
+		END { for (b = 0; b in c; b++) print b*n*0.004 "," lo[b] "," hi[b] "," sum[b]/c[b] }' BIMDC/1.csv \
+	| paste -d, received/ft_summary.txt - | awk -F, '
+		function off(a, b) { return (a > b ? a - b : b - a) > 1e-4 * (b < 0 ? 1 - b : 1 + b) }
+		off($1, $5) || off($2, $6) || off($3, $7) || off($4, $8) { bad++ }
+		END { exit NR == 0 || bad }'
+}
+export -f summaries_match
+check "-g 1" "summaries_match 1 1"
+check "-g 7 -e 2" "summaries_match 2 7"
+check "-g 0" "summaries_match 1 0"
+rm -f received/ft_summary.txt
+
+rm -f BIMDC/$SRC
+echo -e "\n$FAILED checks failed\n"
+exit $FAILED
@@ -1,186 +1,1041 @@
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "RequestChannel.h"
 #include "FIFORequestChannel.h"
+#include "BoundedBuffer.h"
+#include "ServerStats.h"
+#include "ChunkCache.h"
+#include "ChunkCodec.h"
+#include "Checksum.h"
+#include "ChannelRegistry.h"
+#include "FileTransfer.h"
+#include "Rendezvous.h"
+#include "SeriesIndex.h"
+#include "CorePlacement.h"
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 using namespace std;
 
 
 int buffercapacity = MAX_MESSAGE;
+char ipc_type = 'f'; // transport of every channel, the client passes its own "-i" along
 char* buffer = NULL; // buffer used by the server, allocated in the main
 
-int nchannels = 0;
-vector<string> all_data[NUM_PERSONS];
+ChannelRegistry registry; // names the data channels, caps them (-L), closes idle ones (-I, threaded mode)
+int epoll_fd = -1;   // >= 0 in the event-driven mode (-e), where channels have no thread of their own
+ServerStats stats;   // reported through STATS_MSG, and on shutdown with -s
+ChunkCache chunk_cache; // chunks of recently requested files, off unless -k gives it memory
+CorePlacement placement; // CPUs of the channel threads and nodes of the data, off unless -A names them
+
+/* the simulated lookup latency of a data request (-D): none, always delay_us, uniform in
+[0, delay_us) or exponentially distributed with mean delay_us */
+enum DelayModel {NO_DELAY, FIXED_DELAY, UNIFORM_DELAY, EXPONENTIAL_DELAY};
+DelayModel delay_model = UNIFORM_DELAY;
+int delay_us = 5000;
+
+/* each BIMDC row is parsed once at startup into this pair, so that a data
+request is a single array read instead of a split() and two stod() calls */
+struct ecg_sample {
+	double ecg1;
+	double ecg2;
+};
+vector<ecg_sample> all_data[NUM_PERSONS]; // indexed by sample number (seconds / 0.004)
+SeriesIndex series_index[NUM_PERSONS][2];  // ECG 1 and ECG 2 of every person, for AGGREGATE_MSG
+
+// the modification time of st in nanoseconds, so rewrites within one second still differ
+int64_t mtime_ns (const struct stat& st) {
+#ifdef __APPLE__
+	return (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+/* BIMDC files are opened once and then shared by every chunk request for them. The
+shared_ptr keeps a file open while a request still uses it, even after it was replaced
+in the cache. */
+struct cached_file {
+	int fd;
+	struct stat st;  // taken at open, names the version of the file in chunk cache keys
+	cached_file (int _fd) : fd(_fd) { fstat(fd, &st); }
+	~cached_file () { close(fd); }
+
+	ChunkKey chunk_key (__int64_t offset, int length) const {
+		return {(uint64_t) st.st_dev, (uint64_t) st.st_ino, mtime_ns(st), offset, length};
+	}
+};
+unordered_map<string, shared_ptr<cached_file>> open_files;
+mutex open_files_mtx;
+const size_t MAX_OPEN_FILES = 64;  // cached files before those no request holds are closed
 
 
 // pre-declared because function signature required call in process_newchannel_request
-void handle_process_loop (FIFORequestChannel* _channel);
+void handle_process_loop (RequestChannel* _channel, bool _control);
+void watch_channel (RequestChannel* _channel, bool _control);
 
-void process_newchannel_request (FIFORequestChannel* _channel) {
-	nchannels++;
-	string new_channel_name = "data" + to_string(nchannels) + "_";
+const int OPEN_TIMEOUT = 30; // seconds a client has to open a channel it was given
+
+/* Opens the server side of a channel handed to a client, waiting at most OPEN_TIMEOUT
+for the client and not at all once the server stops. NULL if the client never came. */
+RequestChannel* open_for_client (const string& name) {
+	uint64_t deadline = now_ns() + (uint64_t) OPEN_TIMEOUT * 1000000000;
+	RequestChannel* chan = create_channel(ipc_type, name, RequestChannel::SERVER_SIDE, [deadline] {
+		return registry.stopped() || now_ns() > deadline;
+	});
+	if (!chan && !registry.stopped()) {
+		cerr << "Dropping " << name << ", the client did not open it within " << OPEN_TIMEOUT << " s" << endl;
+	}
+	return chan;
+}
+
+int process_newchannel_request (RequestChannel* _channel) {
+	if (!registry.admit()) {
+		cerr << "Refusing a new channel, " << registry.open_channels() << " are open already" << endl;
+		char none = 0;  // an empty name tells the client there is no channel for it
+		return _channel->cwrite(&none, 1);
+	}
+	string new_channel_name = "data" + to_string(registry.allocate_id()) + "_";
 	char buf[30];
 	strcpy(buf, new_channel_name.c_str());
 	_channel->cwrite(buf, new_channel_name.size()+1);
 
-	FIFORequestChannel* data_channel = new FIFORequestChannel(new_channel_name, FIFORequestChannel::SERVER_SIDE);
-	thread thread_for_client(handle_process_loop, data_channel);
-	thread_for_client.detach();
+	RequestChannel* data_channel = open_for_client(new_channel_name);
+	if (!data_channel) {
+		registry.release();
+		return new_channel_name.size()+1;
+	}
+	if (epoll_fd >= 0) {
+		watch_channel(data_channel, false);
+		return new_channel_name.size()+1;
+	}
+	registry.spawn([data_channel] {
+		handle_process_loop(data_channel, false);
+		registry.release();
+	});
+	return new_channel_name.size()+1;
+}
+
+
+/* Parses a decimal number such as "-0.635" at p and moves p past it. The digits are
+gathered into an integer and scaled by an exact power of ten, which rounds the same way as
+strtod as long as the mantissa stays below 2^53; longer numbers and exponents go to strtod. */
+double parse_double (const char*& p, const char* end) {
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const char* start = p;
+	bool negative = (p < end && *p == '-');
+	if (p < end && (*p == '-' || *p == '+')) {
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int digits = 0, decimals = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+		mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, decimals++) {
+			mantissa = mantissa * 10 + (*p - '0');
+		}
+	}
+	if (digits > 15 || (p < end && (*p == 'e' || *p == 'E'))) {
+		// rare in BIMDC files: let the C library do it from a bounded copy
+		char tmp[64];
+		size_t len = min((size_t) (end - start), sizeof(tmp) - 1);
+		memcpy(tmp, start, len);
+		tmp[len] = 0;
+		char* stop;
+		double value = strtod(tmp, &stop);
+		p = start + (stop - tmp);
+		return value;
+	}
+	double value = (double) mantissa / pow10[decimals];
+	return negative ? -value : value;
+}
+
+/* Fills samples from the "seconds,ecg1,ecg2" rows of a CSV file mapped into memory. */
+void parse_csv (const char* p, const char* end, vector<ecg_sample>& samples) {
+	while (p < end) {
+		// the row number already encodes seconds, so the first field is skipped
+		const char* field = (const char*) memchr(p, ',', end - p);
+		const char* eol = (const char*) memchr(p, '\n', end - p);
+		if (!eol) {
+			eol = end;
+		}
+		if (field && field < eol) {
+			ecg_sample s;
+			p = field + 1;
+			s.ecg1 = parse_double(p, eol);
+			if (p < eol && *p == ',') {
+				p++;
+			}
+			s.ecg2 = parse_double(p, eol);
+			samples.push_back(s);
+		}
+		p = eol + 1;
+	}
+}
+
+/* A parsed BIMDC file can be cached next to it as "<person>.ecg" (server -c): a header
+that identifies the CSV it came from, followed by the samples as they are kept in memory. */
+struct sidecar_header {
+	char magic[4];          // "ECG2"
+	uint32_t sample_size;   // sizeof(ecg_sample)
+	int64_t csv_size;
+	int64_t csv_mtime_ns;
+	int64_t count;
+};
+
+bool use_sidecars = false;
+
+bool load_sidecar (const string& path, const struct stat& csv, vector<ecg_sample>& samples) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	sidecar_header h;
+	struct stat st;
+	// the count must be what the file holds, a truncated or corrupt sidecar is parsed again
+	bool ok = fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(h) &&
+		pread(fd, &h, sizeof(h), 0) == sizeof(h) && memcmp(h.magic, "ECG2", 4) == 0 &&
+		h.sample_size == sizeof(ecg_sample) && h.csv_size == csv.st_size && h.csv_mtime_ns == mtime_ns(csv) &&
+		h.count == (int64_t) ((st.st_size - sizeof(h)) / sizeof(ecg_sample)) &&
+		(st.st_size - sizeof(h)) % sizeof(ecg_sample) == 0;
+	if (ok) {
+		samples.resize(h.count);
+		ssize_t len = h.count * sizeof(ecg_sample);
+		ok = pread(fd, samples.data(), len, sizeof(h)) == len;
+	}
+	close(fd);
+	if (!ok) {
+		samples.clear();
+	}
+	return ok;
 }
 
+void save_sidecar (const string& path, const struct stat& csv, const vector<ecg_sample>& samples) {
+	sidecar_header h;
+	memcpy(h.magic, "ECG2", 4);
+	h.sample_size = sizeof(ecg_sample);
+	h.csv_size = csv.st_size;
+	h.csv_mtime_ns = mtime_ns(csv);
+	h.count = samples.size();
+
+	// written under a temporary name and renamed, so a reader never sees half a file
+	string tmp = path + "." + to_string(getpid());
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return;  // the cache is optional, e.g. BIMDC/ may be read-only
+	}
+	ssize_t len = samples.size() * sizeof(ecg_sample);
+	bool ok = write(fd, &h, sizeof(h)) == sizeof(h) && write(fd, samples.data(), len) == len;
+	close(fd);
+	if (!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+		remove(tmp.c_str());
+	}
+}
 
 void populate_file_data (int person) {
 	//cout << "populating for person " << person << endl;
 	string filename = "BIMDC/" + to_string(person) + ".csv";
-	char line[100];
-	ifstream ifs(filename.c_str());
-	if (ifs.fail()){
+	int fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
 		EXITONERROR("Data file: " + filename + " does not exist in the BIMDC/ directory");
 	}
 	
-	while (!ifs.eof()) {
-		line[0] = 0;
-		ifs.getline(line, 100);
-		if (ifs.eof()) {
-			break;
-		}
-		
-		if (line[0]) {
-			all_data[person-1].push_back(string(line));
+	vector<ecg_sample>& samples = all_data[person-1];
+	samples.clear();
+	string sidecar = "BIMDC/" + to_string(person) + ".ecg";
+	if (use_sidecars && load_sidecar(sidecar, st, samples)) {
+		close(fd);
+		return;
+	}
+
+	samples.reserve(15000); // every BIMDC file holds 60 seconds of samples
+	if (st.st_size > 0) {
+		void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			EXITONERROR(filename);
 		}
+		madvise(addr, st.st_size, MADV_SEQUENTIAL);
+		parse_csv((const char*) addr, (const char*) addr + st.st_size, samples);
+		munmap(addr, st.st_size);
+	}
+	close(fd);
+
+	if (use_sidecars) {
+		save_sidecar(sidecar, st, samples);
+	}
+}
+
+// indexes both ECGs of a loaded person for summaries of any window
+void build_series_index (int person) {
+	const vector<ecg_sample>& samples = all_data[person-1];
+	vector<double> ecg1(samples.size()), ecg2(samples.size());
+	for (size_t i = 0; i < samples.size(); i++) {
+		ecg1[i] = samples[i].ecg1;
+		ecg2[i] = samples[i].ecg2;
+	}
+	series_index[person-1][0].build(move(ecg1));
+	series_index[person-1][1].build(move(ecg2));
+}
+
+/* Loads and indexes every person, spread over the available cores; each thread owns whole
+persons, so no two threads touch the same vector. With -A a loader first moves to the node
+of the person, whose memory then holds the samples the loader writes. */
+void populate_all_data () {
+	int nthreads = max(1, min((int) thread::hardware_concurrency(), NUM_PERSONS));
+	vector<thread> loaders;
+	for (int t = 0; t < nthreads; t++) {
+		loaders.push_back(thread([t, nthreads] {
+			for (int person = t + 1; person <= NUM_PERSONS; person += nthreads) {
+				placement.pin_person(person);
+				populate_file_data(person);
+				build_series_index(person);
+			}
+		}));
+	}
+	for (thread& l : loaders) {
+		l.join();
 	}
 }
 
 double get_data_from_memory (int person, double seconds, int ecgno) {
-	int index = (int) round(seconds / 0.004);
-	string line = all_data[person-1][index]; 
-	vector<string> parts = split(line, ',');
+	if (person < 1 || person > NUM_PERSONS) {
+		return 0.0;
+	}
+	const vector<ecg_sample>& samples = all_data[person-1];
+	long index = lround(seconds / 0.004);
+	if (index < 0 || index >= (long) samples.size()) {
+		return 0.0;
+	}
 	
-	double ecg1 = stod(parts[1]);
-	double ecg2 = stod(parts[2]); 
+	const ecg_sample& s = samples[index];
 	if (ecgno == 1) {
-		return ecg1;
+		return s.ecg1;
 	}
 	else {
-		return ecg2;
+		return s.ecg2;
+	}
+}
+
+// copies up to count consecutive values of one ECG into out, returns how many were copied
+int get_range_from_memory (int person, double seconds, int ecgno, int count, double* out) {
+	if (person < 1 || person > NUM_PERSONS) {
+		return 0;
+	}
+	const vector<ecg_sample>& samples = all_data[person-1];
+	long index = lround(seconds / 0.004);
+	if (index < 0 || index >= (long) samples.size()) {
+		return 0;
+	}
+	
+	int n = (int) min((long) count, (long) samples.size() - index);
+	const ecg_sample* s = samples.data() + index;
+	for (int i = 0; i < n; i++) {
+		out[i] = (ecgno == 1) ? s[i].ecg1 : s[i].ecg2;
+	}
+	return n;
+}
+
+int process_unknown_request (RequestChannel* rc) {
+	char a = 0;
+	return rc->cwrite(&a, sizeof(char));
+}
+
+atomic<uint64_t> open_files_generation(0); // bumped whenever a file is (re)opened
+
+/* Returns the open file for filename, or NULL if it cannot be opened. A size request starts
+every transfer and passes reopen: the path is stat'ed, and only a file that was replaced or
+rewritten on disk (another device, inode or mtime) is opened again, so an unchanged file
+keeps the descriptors every thread remembers. */
+shared_ptr<cached_file> open_cached_file (const string& filename, bool reopen) {
+	lock_guard<mutex> lock(open_files_mtx);
+	auto it = open_files.find(filename);
+	if (it != open_files.end()) {
+		struct stat st;
+		const struct stat& cached = it->second->st;
+		if (!reopen || (stat(filename.c_str(), &st) == 0 && st.st_dev == cached.st_dev &&
+				st.st_ino == cached.st_ino && mtime_ns(st) == mtime_ns(cached))) {
+			return it->second;
+		}
+	}
+	int fd = open(filename.c_str(), O_RDONLY);
+	open_files_generation++;
+	if (fd < 0) {
+		open_files.erase(filename);
+		return NULL;
 	}
+	if (open_files.size() >= MAX_OPEN_FILES && !open_files.count(filename)) {
+		/* a daemon sees any number of file names over its life; keep only the files some
+		thread still holds, so their descriptors stay below RLIMIT_NOFILE */
+		for (auto i = open_files.begin(); i != open_files.end(); ) {
+			i = (i->second.use_count() == 1) ? open_files.erase(i) : next(i);
+		}
+	}
+	shared_ptr<cached_file> file = make_shared<cached_file>(fd);
+	open_files[filename] = file;
+	return file;
 }
 
-void process_file_request (FIFORequestChannel* rc, char* request) {
-	filemsg f = *((filemsg*) request);
-	string filename = request + sizeof(filemsg);
-	filename = "BIMDC/" + filename; // adding the path prefix to the requested file name
-	//cout << "Server received request for file " << filename << endl;
+/* Every thread remembers the file of its last chunk request, so the chunks of a transfer
+find their file without building its path or taking the open_files lock. The remembered
+file is dropped as soon as any file was reopened. */
+thread_local string last_name;
+thread_local shared_ptr<cached_file> last_file;
+thread_local uint64_t last_generation = 0;
+
+shared_ptr<cached_file>& chunk_file (string_view name) {
+	uint64_t generation = open_files_generation.load();
+	if (!last_file || generation != last_generation || name != last_name) {
+		last_name.assign(name.data(), name.size());
+		last_generation = generation;
+		last_file = open_cached_file("BIMDC/" + last_name, false);
+	}
+	return last_file;
+}
+
+/* The reply to a FILEZ_MSG: the chunk's length and then the chunk packed on its own, so
+any chunk can still be requested at any offset. The raw chunk comes from the chunk cache
+when it is on, otherwise it is read into response. */
+int send_packed_chunk (RequestChannel* rc, cached_file& file, const FileRequestView& f, char* response) {
+	ChunkCache::Chunk chunk;
+	ChunkKey key = file.chunk_key(f.offset, f.length);
+	if (chunk_cache.enabled()) {
+		chunk = chunk_cache.get(key);
+	}
+	const char* raw = response;
+	int got;
+	if (chunk) {
+		raw = chunk->data();
+		got = chunk->size();
+	}
+	else {
+		got = max((int) pread(file.fd, response, f.length, f.offset), 0);
+		if (got == f.length && chunk_cache.enabled()) {
+			chunk_cache.put(key, response, got);
+		}
+	}
+	if (got != f.length) {
+		cerr << "Could only read " << got << " of " << f.length << " bytes of BIMDC/" << f.filename << endl;
+	}
+
+	thread_local vector<char> packed;  // grows to the buffer capacity once per thread
+	if ((int) packed.size() < pack_bound(got)) {
+		packed.resize(pack_bound(max(got, buffercapacity)));
+	}
+	int n = pack_chunk(raw, got, packed.data());
+	struct iovec iov[2] = {{&got, sizeof(int)}, {packed.data(), (size_t) n}};
+	return rc->cwritev(iov, 2);
+}
+
+/* The reply to a FILESUM_MSG: the checksums of the chunks of f.length bytes from f.offset
+on, as many as fit into a chunk and exist in the file. Every chunk is read on its own, so
+a transfer can check its chunks no matter which of them it still needs. */
+int send_chunk_checksums (RequestChannel* rc, cached_file& file, const FileRequestView& f, char* response) {
+	struct stat st;
+	__int64_t filesize = fstat(file.fd, &st) == 0 ? st.st_size : 0;
+	thread_local vector<char> chunk;  // grows to the buffer capacity once per thread
+	if ((int) chunk.size() < f.length) {
+		chunk.resize(buffercapacity);
+	}
+	uint64_t* sums = (uint64_t*) response;
+	int n = 0;
+	if (f.offset >= 0 && f.length > 0) {
+		int capacity = filesum_capacity(f.length);
+		for (__int64_t offset = f.offset; n < capacity && offset < filesize; offset += f.length) {
+			int len = (int) min((__int64_t) f.length, filesize - offset);
+			if (pread(file.fd, chunk.data(), len, offset) != len) {
+				cerr << "Could not read " << len << " bytes of BIMDC/" << f.filename << " at " << offset << endl;
+				break;
+			}
+			sums[n++] = chunk_checksum(chunk.data(), len);
+		}
+	}
+	struct iovec iov[2] = {{&n, sizeof(int)}, {sums, n * sizeof(uint64_t)}};
+	return rc->cwritev(iov, 2);
+}
+
+int process_file_request (RequestChannel* rc, char* request, int size, char* response) {
+	FileRequestView f;
+	if (!decode_file_request(request, size, f)) {
+		return process_unknown_request(rc);
+	}
+	//cout << "Server received request for file " << f.filename << endl;
 
 	if (f.offset == 0 && f.length == 0) { // means that the client is asking for file size
-		__int64_t fs = get_file_size (filename);
-		rc->cwrite ((char*) &fs, sizeof(__int64_t));
-		return;
+		// adding the path prefix to the requested file name
+		shared_ptr<cached_file> file = open_cached_file("BIMDC/" + string(f.filename), true);
+		struct stat st;
+		__int64_t fs = (file && fstat(file->fd, &st) == 0) ? st.st_size : 0;
+		return rc->cwrite ((char*) &fs, sizeof(__int64_t));
 	}
 
-	/* request buffer can be used for response buffer, because everything necessary have
-	been copied over to filemsg f and filename*/
-	char* response = request; 
+	/* the response gets its own buffer: the request buffer may already hold the next
+	pipelined requests behind this one */
 
 	// make sure that client is not requesting too big a chunk
 	if (f.length > buffercapacity) {
 		cerr << "Client is requesting a chunk bigger than server's capacity" << endl;
 		cerr << "Returning nothing (i.e., 0 bytes) in response" << endl;
-		rc->cwrite(response, 0);
+		return rc->cwrite(response, 0);
 	}
 
-	FILE* fp = fopen(filename.c_str(), "rb");
-	if (!fp) {
-		cerr << "Server received request for file: " << filename << " which cannot be opened" << endl;
-		rc->cwrite(buffer, 0);
-		return;
+	shared_ptr<cached_file>& file = chunk_file(f.filename);
+	if (!file) {
+		cerr << "Server received request for file: BIMDC/" << f.filename << " which cannot be opened" << endl;
+		return rc->cwrite(buffer, 0);
+	}
+	uint64_t start = now_ns();
+	int nbytes;
+	MESSAGE_TYPE m;
+	memcpy(&m, request, sizeof(MESSAGE_TYPE));
+	if (m == FILEZ_MSG || m == FILESUM_MSG) {
+		int sent = (m == FILEZ_MSG) ? send_packed_chunk(rc, *file, f, response) : send_chunk_checksums(rc, *file, f, response);
+		stats.record_phase(ServerStats::FILE_PHASE, now_ns() - start);
+		return sent;
+	}
+	if (chunk_cache.enabled()) {
+		// hot chunks come from memory; a miss reads the chunk once and keeps a copy
+		ChunkKey key = file->chunk_key(f.offset, f.length);
+		ChunkCache::Chunk chunk = chunk_cache.get(key);
+		if (chunk) {
+			nbytes = rc->cwrite((char*) chunk->data(), chunk->size());
+		}
+		else {
+			int got = pread(file->fd, response, f.length, f.offset);
+			if (got == f.length) {
+				chunk_cache.put(key, response, got);
+			}
+			nbytes = rc->cwrite(response, max(got, 0));
+		}
+	}
+	else {
+		/* the chunk goes from the file into the channel, without a copy through the response
+		buffer where the transport supports it */
+		nbytes = rc->csendfile(file->fd, f.offset, f.length, response);
 	}
-	fseek(fp, f.offset, SEEK_SET);
-	int nbytes = fread(response, 1, f.length, fp);
+	stats.record_phase(ServerStats::FILE_PHASE, now_ns() - start);
 
 	/* making sure that the client is asking for the right # of bytes,
 	this is especially imp for the last chunk of a file when the 
 	remaining lenght is < buffercap of the client*/
-	assert(nbytes == f.length); 
+	if (nbytes != f.length) {
+		cerr << "Could only send " << nbytes << " of " << f.length << " bytes of BIMDC/" << f.filename << endl;
+	}
+	return nbytes;
+}
 
-	rc->cwrite(response, nbytes);
-	fclose(fp);
+int process_data_request (RequestChannel* rc, char* request) {
+	datamsg d(0, 0, 0);
+	memcpy(&d, request, sizeof(datamsg));
+	uint64_t start = now_ns();
+	double data = get_data_from_memory(d.person, d.seconds, d.ecgno);
+	stats.record_phase(ServerStats::LOOKUP_PHASE, now_ns() - start);
+	return rc->cwrite(&data, sizeof(double));
 }
 
-void process_data_request (FIFORequestChannel* rc, char* request) {
-	datamsg* d = (datamsg*) request;
-	double data = get_data_from_memory(d->person, d->seconds, d->ecgno);
-	rc->cwrite(&data, sizeof(double));
+int process_data_pair_request (RequestChannel* rc, char* request) {
+	datapairmsg d(0, 0);
+	memcpy(&d, request, sizeof(datapairmsg));
+	uint64_t start = now_ns();
+	double data[2] = {get_data_from_memory(d.person, d.seconds, 1), get_data_from_memory(d.person, d.seconds, 2)};
+	stats.record_phase(ServerStats::LOOKUP_PHASE, now_ns() - start);
+	return rc->cwrite(data, sizeof(data));
 }
 
-void process_unknown_request (FIFORequestChannel* rc) {
-	char a = 0;
-	rc->cwrite(&a, sizeof(char));
+int process_data_range_request (RequestChannel* rc, char* request, char* response) {
+	datarangemsg d(0, 0, 0, 0);
+	memcpy(&d, request, sizeof(datarangemsg));
+	int count = min(d.count, datarange_capacity(buffercapacity));
+	
+	// the reply is the number of points followed by the points, sent from where they are
+	double* points = (double*) response;
+	uint64_t start = now_ns();
+	int n = get_range_from_memory(d.person, d.seconds, d.ecgno, max(count, 0), points);
+	stats.record_phase(ServerStats::LOOKUP_PHASE, now_ns() - start);
+	struct iovec iov[2] = {{&n, sizeof(int)}, {points, n * sizeof(double)}};
+	return rc->cwritev(iov, 2);
+}
+
+/* The summaries are built in response behind the two ints of the reply; every one of them
+takes O(1) block lookups and a scan of at most two partial blocks, however many points its
+bucket holds. */
+int process_aggregate_request (RequestChannel* rc, char* request, char* response) {
+	aggregatemsg a(0, 0, 0, 0, 0);
+	memcpy(&a, request, sizeof(aggregatemsg));
+	int header[2] = {0, 0};  // summaries, points covered
+	ecg_summary* summaries = (ecg_summary*) response;
+	uint64_t start = now_ns();
+	long index = lround(a.seconds / 0.004);
+	if (a.person >= 1 && a.person <= NUM_PERSONS && (a.ecgno == 1 || a.ecgno == 2) && a.count > 0) {
+		const SeriesIndex& series = series_index[a.person-1][a.ecgno-1];
+		if (index >= 0 && index < (long) series.size()) {
+			long points = min((long) a.count, (long) series.size() - index);
+			long bucket = (a.bucket <= 0) ? points : min((long) a.bucket, points);
+			long n = min((points + bucket - 1) / bucket, (long) aggregate_capacity(buffercapacity));
+			for (long i = 0; i < n; i++) {
+				long begin = index + i * bucket;
+				summaries[i] = series.summary(begin, min(begin + bucket, index + points));
+			}
+			header[0] = n;
+			header[1] = min(points, n * bucket);
+		}
+	}
+	stats.record_phase(ServerStats::LOOKUP_PHASE, now_ns() - start);
+	struct iovec iov[2] = {{header, sizeof(header)}, {summaries, header[0] * sizeof(ecg_summary)}};
+	return rc->cwritev(iov, 2);
+}
+
+int process_stats_request (RequestChannel* rc) {
+	string text = stats.report() + (chunk_cache.enabled() ? chunk_cache.report() : "");
+	__int64_t len = text.size();
+	rc->cwrite(&len, sizeof(__int64_t));
+	return rc->cwrite((char*) text.data(), len);
+}
+
+
+/* parses "-D model[:microseconds]" with model none, fixed, uniform or exp; the time
+defaults to 5000, so "-D uniform" is the original delay */
+bool parse_delay_model (const string& arg) {
+	size_t colon = arg.find(':');
+	string model = arg.substr(0, colon);
+	int us = (colon == string::npos) ? 5000 : atoi(arg.c_str() + colon + 1);
+	if (us < 0) {
+		return false;
+	}
+	if (model == "none") {
+		delay_model = NO_DELAY;
+	}
+	else if (model == "fixed") {
+		delay_model = FIXED_DELAY;
+	}
+	else if (model == "uniform") {
+		delay_model = UNIFORM_DELAY;
+	}
+	else if (model == "exp") {
+		delay_model = EXPONENTIAL_DELAY;
+	}
+	else {
+		return false;
+	}
+	delay_us = us;
+	return true;
+}
+
+// sleeps for the simulated lookup latency of a data request
+void request_delay () {
+	if (delay_model == NO_DELAY || delay_us == 0) {
+		return;
+	}
+	// every thread draws from its own generator, rand() would share one state between all
+	thread_local mt19937 rng(random_device{}());
+	int us = delay_us;
+	if (delay_model == UNIFORM_DELAY) {
+		us = uniform_int_distribution<int>(0, delay_us - 1)(rng);
+	}
+	else if (delay_model == EXPONENTIAL_DELAY) {
+		us = (int) exponential_distribution<double>(1.0 / delay_us)(rng);
+	}
+	uint64_t start = now_ns();
+	usleep(us);
+	stats.record_phase(ServerStats::DELAY_PHASE, now_ns() - start);
 }
 
 
-void process_request (FIFORequestChannel *rc, char* _request) {
-	MESSAGE_TYPE m = *((MESSAGE_TYPE*) _request);
+// processes the request of _size bytes at _request and returns the number of bytes of the reply
+int process_request (RequestChannel *rc, char* _request, int _size, char* _response) {
+	MESSAGE_TYPE m;
+	memcpy(&m, _request, sizeof(MESSAGE_TYPE));
+	uint64_t start = now_ns();
+	int nbytes;
 	if (m == DATA_MSG) {
-		usleep(rand() % 5000);
-		process_data_request(rc, _request);
+		request_delay();
+		nbytes = process_data_request(rc, _request);
+	}
+	else if (m == DATA_PAIR_MSG) {
+		request_delay();  // one lookup delay for both ECGs
+		nbytes = process_data_pair_request(rc, _request);
+	}
+	else if (m == DATA_RANGE_MSG) {
+		request_delay();  // one lookup delay for the whole batch
+		nbytes = process_data_range_request(rc, _request, _response);
+	}
+	else if (m == AGGREGATE_MSG) {
+		request_delay();  // one lookup delay for every summary of the reply
+		nbytes = process_aggregate_request(rc, _request, _response);
 	}
-	else if (m == FILE_MSG) {
-		process_file_request(rc, _request);
+	else if (m == FILE_MSG || m == FILEZ_MSG || m == FILESUM_MSG) {
+		nbytes = process_file_request(rc, _request, _size, _response);
 	}
 	else if (m == NEWCHANNEL_MSG) {
-		process_newchannel_request(rc);
+		nbytes = process_newchannel_request(rc);
+	}
+	else if (m == STATS_MSG) {
+		nbytes = process_stats_request(rc);
 	}
 	else {
-		process_unknown_request(rc);
+		nbytes = process_unknown_request(rc);
+	}
+	nbytes = max(nbytes, 0);
+	stats.record_request(m, now_ns() - start, nbytes);
+	return nbytes;
+}
+
+/* Reads the next request on the channel and processes it; every cread returns exactly one
+request, however the client pipelines them. Returns false once the channel is finished
+(QUIT_MSG, error or closed by the client). */
+bool read_and_process (RequestChannel* channel, ChannelStats* cs, char* buffer, char* response) {
+	uint64_t read_start = now_ns();
+	int nbytes = channel->cread(buffer, buffercapacity);
+	stats.record_phase(ServerStats::READ_PHASE, now_ns() - read_start);
+	if (nbytes < 0) {
+		cerr << "Client-side terminated abnormally" << endl;
+		return false;
+	}
+	else if (nbytes == 0) {
+		cout << "Server could not read anything... Terminating" << endl;
+		return false;
+	}
+
+	MESSAGE_TYPE m = UNKNOWN_MSG;
+	memcpy(&m, buffer, min(nbytes, (int) sizeof(MESSAGE_TYPE)));
+	if (m == QUIT_MSG) {  // note that QUIT_MSG does not get a reply from the server
+		cout << "Client-side is done and exited" << endl;
+		return false;
 	}
+	int replied = process_request(channel, buffer, nbytes, response);
+	cs->requests.fetch_add(1, memory_order_relaxed);
+	cs->bytes_in.fetch_add(nbytes, memory_order_relaxed);
+	cs->bytes_out.fetch_add(replied, memory_order_relaxed);
+	return true;
 }
 
-void handle_process_loop (FIFORequestChannel *channel) {
+void handle_process_loop (RequestChannel *channel, bool control) {
+	if (!control) {
+		placement.pin_thread();  // before the buffers, so they are allocated on its node
+	}
 	/* creating a buffer per client to process incoming requests
 	and prepare a response */
 	char* buffer = new char[buffercapacity];
-	if (!buffer) {
+	char* response = new char[buffercapacity];
+	if (!buffer || !response) {
 		EXITONERROR ("Cannot allocate memory for server buffer");
 	}
 
+	ChannelStats* cs = stats.open_channel(channel->name());
+	while (registry.wait_for_request(channel, !control) && read_and_process(channel, cs, buffer, response)) {
+	}
+	stats.close_channel(cs);
+	delete[] response;
+	delete[] buffer;
+	delete channel;
+}
+
+/*--------------------------------------------------------------------------*/
+/*	EVENT-DRIVEN MODE: one epoll loop, a fixed pool of worker threads		*/
+/*--------------------------------------------------------------------------*/
+
+/* Everything a channel needs between two readiness events. Each channel is registered
+with EPOLLONESHOT, so at most one worker owns its state at a time and re-arms it when done. */
+struct channel_state {
+	RequestChannel* channel;
+	ChannelStats* cs;
+	bool control;
+	char* buffer;
+};
+
+mutex states_mtx;
+vector<channel_state*> states;   // all watched channels, to clean up on shutdown
+atomic<bool> server_done(false);
+
+void watch_channel (RequestChannel* _channel, bool _control) {
+#ifdef __linux__
+	channel_state* st = new channel_state;
+	st->channel = _channel;
+	st->cs = stats.open_channel(_channel->name());
+	st->control = _control;
+	st->buffer = new char[buffercapacity];
+	{
+		lock_guard<mutex> lock(states_mtx);
+		states.push_back(st);
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = st;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, _channel->read_fd(), &ev) < 0) {
+		EXITONERROR("epoll_ctl");
+	}
+#else
+	(void) _channel;
+	(void) _control;
+#endif
+}
+
+void unwatch_channel (channel_state* st) {
+	{
+		lock_guard<mutex> lock(states_mtx);
+		states.erase(find(states.begin(), states.end(), st));
+	}
+	stats.close_channel(st->cs);
+	if (!st->control) {
+		registry.release();
+	}
+	delete st->channel;  // closing the descriptor also removes it from the epoll set
+	delete[] st->buffer;
+	delete st;
+}
+
+// runs the requests of whichever channel became readable, then hands it back to epoll
+void event_worker (BoundedBuffer* ready) {
+	placement.pin_thread();
+	char* response = new char[buffercapacity];
 	while (true) {
-		int nbytes = channel->cread(buffer, buffercapacity);
-		if (nbytes < 0) {
-			cerr << "Client-side terminated abnormally" << endl;
+		channel_state* st = NULL;
+		ready->pop((char*) &st, sizeof(st));
+		if (!st) {
 			break;
 		}
-		else if (nbytes == 0) {
-			cout << "Server could not read anything... Terminating" << endl;
-			break;
+		if (!read_and_process(st->channel, st->cs, st->buffer, response)) {
+			if (st->control) {
+				server_done = true;
+			}
+			unwatch_channel(st);
+			continue;
 		}
+#ifdef __linux__
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLONESHOT;
+		ev.data.ptr = st;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, st->channel->read_fd(), &ev);
+#endif
+	}
+	delete[] response;
+}
 
-		MESSAGE_TYPE m = *((MESSAGE_TYPE*) buffer);
-		if (m == QUIT_MSG) {  // note that QUIT_MSG does not get a reply from the server
-			cout << "Client-side is done and exited" << endl;
-			break;
+void serve_clients (const string path);
+
+/* Serves every channel with nworkers threads no matter how many channels the clients open.
+Returns when the control channel quits, or in daemon mode (no control channel, clients
+come in at rendezvous) when the server is stopped. */
+void run_event_loop (RequestChannel* control_channel, int nworkers, const string rendezvous) {
+#ifdef __linux__
+	epoll_fd = epoll_create1(0);
+	if (epoll_fd < 0) {
+		EXITONERROR("epoll_create1");
+	}
+	BoundedBuffer ready(1024);
+	vector<thread> workers;
+	for (int i = 0; i < nworkers; i++) {
+		workers.push_back(thread(event_worker, &ready));
+	}
+	if (control_channel) {
+		watch_channel(control_channel, true);
+	}
+	thread acceptor;
+	if (!rendezvous.empty()) {
+		acceptor = thread(serve_clients, rendezvous);
+	}
+
+	const int MAX_EVENTS = 64;
+	struct epoll_event events[MAX_EVENTS];
+	while (!server_done) {
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 100); // wakes up to notice server_done
+		for (int i = 0; i < n; i++) {
+			channel_state* st = (channel_state*) events[i].data.ptr;
+			ready.push((char*) &st, sizeof(st));
 		}
-		process_request(channel, buffer);
 	}
-	delete[] buffer;
-	delete channel;
+
+	if (acceptor.joinable()) {
+		acceptor.join();
+	}
+	for (int i = 0; i < nworkers; i++) {
+		channel_state* stop = NULL;
+		ready.push((char*) &stop, sizeof(stop));
+	}
+	for (thread& w : workers) {
+		w.join();
+	}
+	while (!states.empty()) {
+		unwatch_channel(states.back());
+	}
+	close(epoll_fd);
+#else
+	(void) control_channel;
+	(void) nworkers;
+	(void) rendezvous;
+#endif
+}
+
+/*--------------------------------------------------------------------------*/
+/*	DAEMON MODE: one long-lived server shared by many client processes		*/
+/*--------------------------------------------------------------------------*/
+
+void stop_server (int) {
+	server_done = true;
+}
+
+/* Accepts clients at the rendezvous socket until the server is stopped. Every client gets
+a control channel of its own, served like the control channel of a private server, except
+that its QUIT_MSG ends only that client's session. */
+void serve_clients (const string path) {
+	int lfd = rendezvous_listen(path);
+	cout << "Serving clients at " << path << endl;
+	while (!server_done) {
+		struct pollfd p = {lfd, POLLIN, 0};
+		if (poll(&p, 1, 100) <= 0) { // wakes up to notice server_done
+			continue;
+		}
+		int conn = accept(lfd, NULL, NULL);
+		if (conn < 0) {
+			continue;
+		}
+		string name;
+		if (registry.admit()) {
+			name = "control" + to_string(registry.allocate_id()) + "_";
+			// the channel opens in the session's thread, a client that never shows up holds only that
+			registry.spawn([name] {
+				RequestChannel* control = open_for_client(name);
+				if (!control) {
+					registry.release();
+					return;
+				}
+				if (epoll_fd >= 0) {
+					watch_channel(control, false);
+					return;
+				}
+				handle_process_loop(control, true);
+				registry.release();
+			});
+		}
+		else {
+			cerr << "Refusing a new client, " << registry.open_channels() << " channels are open already" << endl;
+		}
+		rendezvous_reply(conn, ipc_type, name, buffercapacity);
+		close(conn);
+	}
+	close(lfd);
+	unlink(path.c_str());
 }
 
 int main (int argc, char *argv[]) {
 	buffercapacity = MAX_MESSAGE;
 	int opt;
-	while ((opt = getopt(argc, argv, "m:")) != -1) {
+	int nworkers = 0; // > 0 selects the event-driven mode with this many worker threads
+	bool dump_stats = false;
+	int max_channels = 0, idle_seconds = 0; // no limits by default
+	string rendezvous = "";  // set by -d/-R: daemon mode, serving every client that connects there
+	string cpus = "";  // -A: "all" or a list of CPUs to pin the threads to
+	while ((opt = getopt(argc, argv, "m:i:e:csP:D:k:L:I:dR:A:")) != -1) {
 		switch (opt) {
 			case 'm':
 				buffercapacity = atoi(optarg);
 				break;
+			case 'i':
+				ipc_type = optarg[0];
+				break;
+			case 'e':
+				nworkers = atoi(optarg);
+				break;
+			case 'c':
+				use_sidecars = true;
+				break;
+			case 's':
+				dump_stats = true;
+				break;
+			case 'P':
+				FIFORequestChannel::set_pipe_size(atoi(optarg));
+				break;
+			case 'D':
+				if (!parse_delay_model(optarg)) {
+					cerr << "Unknown delay model " << optarg << ", use none, fixed[:us], uniform[:us] or exp[:us]" << endl;
+					return 1;
+				}
+				break;
+			case 'k':
+				chunk_cache.set_capacity((size_t) max(atoi(optarg), 0) << 20);
+				break;
+			case 'L':
+				max_channels = atoi(optarg);
+				break;
+			case 'I':
+				idle_seconds = atoi(optarg);
+				break;
+			case 'd':
+				rendezvous = RENDEZVOUS_PATH;
+				break;
+			case 'R':
+				rendezvous = optarg;
+				break;
+			case 'A':
+				cpus = optarg;
+				break;
 		}
 	}
+	if (!valid_ipc_type(ipc_type)) {
+		cerr << "Unknown IPC type " << ipc_type << ", use " << IPC_TYPE_USAGE << endl;
+		return 1;
+	}
+#ifdef __linux__
+	if (nworkers > 0 && ipc_type == 's') {
+		cerr << "The event-driven mode needs a pollable transport, shared memory channels have none" << endl;
+		return 1;
+	}
+#else
+	if (nworkers > 0) {
+		cerr << "The event-driven mode needs epoll, which only exists on Linux" << endl;
+		return 1;
+	}
+#endif
 
-	srand(time_t(NULL));
-	for (int i = 0; i < NUM_PERSONS; i++) {
-		populate_file_data(i+1);
+	if (!cpus.empty()) {
+		if (!placement.configure(cpus)) {
+			return 1;
+		}
+		placement.pin_all();  // every thread starts out on the set, channel threads narrow it down
+		cout << placement.layout();
 	}
+
+	registry.set_limits(max_channels, idle_seconds);
+	populate_all_data();
 	
-	FIFORequestChannel* control_channel = new FIFORequestChannel("control", FIFORequestChannel::SERVER_SIDE);
-	handle_process_loop(control_channel);
+	if (!rendezvous.empty()) {
+		// runs until SIGINT/SIGTERM; a client that vanishes must not take the server along
+		signal(SIGPIPE, SIG_IGN);
+		signal(SIGINT, stop_server);
+		signal(SIGTERM, stop_server);
+		if (nworkers > 0) {
+			run_event_loop(NULL, nworkers, rendezvous);
+		}
+		else {
+			serve_clients(rendezvous);
+		}
+	}
+	else {
+		RequestChannel* control_channel = create_channel(ipc_type, "control", RequestChannel::SERVER_SIDE);
+		if (nworkers > 0) {
+			run_event_loop(control_channel, nworkers, "");
+		}
+		else {
+			handle_process_loop(control_channel, true);
+		}
+	}
+	registry.shutdown();
+	if (dump_stats) {
+		cerr << stats.report() << (chunk_cache.enabled() ? chunk_cache.report() : "");
+	}
 	cout << "Server terminated" << endl;
 }